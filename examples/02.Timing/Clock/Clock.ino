@@ -26,12 +26,15 @@
   myclock.setHours(18);
   myclock.setMinutes(0);
   myclock.setSeconds(0);
+  myclock.setDate(12, 3, 2021);
   */
+  //Correct the crystal error of the board (ppm, positive if the board runs fast)
+  myclock.setTrim(0);
   printerTimer.attach(1500, printClock);
  }
 
  void printClock() {
-     printer.print("%d:%d:%d\n",myclock.getHours(), myclock.getMinutes(), myclock.getSeconds());
+     printer.print("%d/%d/%d %d:%d:%d\n", myclock.getDay(), myclock.getMonth(), myclock.getYear(), myclock.getHours(), myclock.getMinutes(), myclock.getSeconds());
  }
 
  void loop() {
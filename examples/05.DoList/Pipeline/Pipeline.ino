@@ -0,0 +1,39 @@
+/*
+ * 
+ * DOLIST PIPELINE EXAMPLE FOR TWEAKLY
+ * Created By Mirko Pacioni
+ * 
+ * A pipeline runs its tasks by itself : each step lasts its dwell time,
+ * and when it has a predicate it also waits for it to return true.
+ * 
+ */
+ #include "Tweakly.h"
+
+ //Create led Pad
+ Pad led(6);
+
+ //Create list
+ doList measure;
+
+ int sample = 0;
+
+ void setup() {
+  //Start Serial
+  Serial.begin(115200);
+  
+  //Led on, wait 200ms
+  measure.addTask([] { led.on(); }, 200);
+  //Sample, wait 50ms
+  measure.addTask([] { sample = analogRead(A0); }, 50);
+  //Led off and send, wait until the Serial has room
+  measure.addTask([] { led.off(); Serial.println(sample); }, 0, [] { return Serial.availableForWrite() > 8; });
+
+  //Play the steps forever, PIPELINE_ONCE and PIPELINE_PING_PONG are the other modes
+  measure.play(PIPELINE_LOOP);
+ }
+
+ void loop() {
+  //Call Tweakly for ever, it runs the pipeline
+  TweaklyRun();
+  //Put your code here :-)
+ }
@@ -0,0 +1,37 @@
+/*
+ * 
+ * DOLIST TABLE TASKS EXAMPLE FOR TWEAKLY
+ * Created By Mirko Pacioni
+ * 
+ * The tasks of this list are a constant table kept in flash, they use no RAM.
+ * 
+ */
+ #include "Tweakly.h"
+
+ int counterVal = 0;
+
+ void increment() { counterVal++; }
+ void show() { Serial.println(counterVal); }
+
+ //Table of tasks, PROGMEM keeps it in flash on AVR boards
+ const doTask steps[] PROGMEM = { increment, increment, show };
+
+ //Create list from the table, true because the table is PROGMEM
+ doList myTasks(steps, true);
+
+ //Create timer
+ TickTimer timer;
+
+ void setup() {
+  //Start Serial
+  Serial.begin(115200);
+
+  //Start timer
+  timer.attach(500, []{ myTasks.next(); });
+ }
+
+ void loop() {
+  //Call Tweakly for ever
+  TweaklyRun();
+  //Put your code here :-)
+ }
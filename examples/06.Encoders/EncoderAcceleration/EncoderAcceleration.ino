@@ -0,0 +1,42 @@
+/*
+ * 
+ * ENCODER ACCELERATION EXAMPLE FOR TWEAKLY
+ * Created By Mirko Pacioni
+ * 
+ * The callback receives the steps done since the previous call,
+ * spinning the knob fast multiplies the steps for each detent.
+ * 
+ */
+ #include "Tweakly.h"
+
+ //Create pads
+ Pad clk(2, INPUT_PULLUP);
+ Pad dt(3, INPUT_PULLUP);
+
+ int counterVal = 0;
+ 
+ void setup() {
+  //Start Serial
+  Serial.begin(115200);
+  //Set encoder with a steps callback
+  encoderAttach(dt.pinNumber(), clk.pinNumber(), onEncoderSteps);
+  //Accelerate above 10 detents per second, up to 20 steps for each detent, at most 25 callbacks per second
+  encoderSettings settings;
+  settings.accelerationSpeed = 10;
+  settings.maxMultiplier = 20;
+  settings.callbackInterval = 40;
+  encoderAdjust(clk.pinNumber(), settings);
+ }
+
+ void onEncoderSteps(int steps) {
+  //Add steps to counterVal and keep it between 0 and 1000
+  counterVal = constrain(counterVal + steps, 0, 1000);
+  //Print value of counterVal
+  Serial.println(counterVal);
+ }
+
+ void loop() {
+  //Call Tweakly for ever
+  TweaklyRun();
+  //Put your code here :-)
+ }
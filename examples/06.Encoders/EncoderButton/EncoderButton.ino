@@ -7,8 +7,8 @@
  #include "Tweakly.h"
 
  //Create pads
- Pad clk(7, INPUT_PULLUP);
- Pad dt(8, INPUT_PULLUP);
+ Pad clk(2, INPUT_PULLUP);
+ Pad dt(3, INPUT_PULLUP);
  Pad button(12, INPUT_PULLUP);
  
  void setup() {
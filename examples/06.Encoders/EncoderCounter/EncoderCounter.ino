@@ -6,9 +6,11 @@
  */
  #include "Tweakly.h"
 
- //Create pads
- Pad clk(7, INPUT_PULLUP);
- Pad dt(8, INPUT_PULLUP);
+ //Create pads (on an Uno only pins 2 and 3 decode by interrupt, other pins are
+ //polled by TweaklyRun and miss fast turns, unless TWEAKLY_PIN_CHANGE is defined
+ //before including Tweakly.h)
+ Pad clk(2, INPUT_PULLUP);
+ Pad dt(3, INPUT_PULLUP);
 
  int counterVal = 0;
  
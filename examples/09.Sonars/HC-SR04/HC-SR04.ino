@@ -7,8 +7,10 @@
 */
 #include "Tweakly.h"
 
-//Set sonar pin
-Pad echoPin(7, INPUT);
+//Set sonar pin (on an Uno only pins 2 and 3 time the echo by interrupt, other pins
+//are polled by TweaklyRun and lose about 17cm per millisecond of loop, unless
+//TWEAKLY_PIN_CHANGE is defined before including Tweakly.h)
+Pad echoPin(2, INPUT);
 Pad triggerPin(8, OUTPUT);
 
 //Create Echo object
@@ -0,0 +1,41 @@
+/*
+*
+*  ECHO BINARY EXAMPLE FOR TWEAKLY
+*  Created By Mirko Pacioni
+*
+*  The Echo sends compact records instead of text, decode them on your computer with :
+*  python3 extras/echo_decode.py /dev/ttyUSB0 path/to/Echo_Binary --baud 115200
+*
+*/
+#include "Tweakly.h"
+
+//Create Echo object
+Echo printer;
+
+//Create a timer for the samples
+TickTimer sampler;
+
+void setup() {
+
+  //Start serial
+  Serial.begin(115200);
+
+  //Attach serial to Echo object
+  printer.attach(&Serial);
+
+  //Send binary records, buffered and drained by TweaklyRun
+  printer.binary(true);
+  printer.buffer(128, ECHO_DROP);
+
+  //Log a sample every 10ms
+  sampler.attach(10, [](){
+    ECHO_LOG(printer, "A0 : %d, dropped : %lu \n", analogRead(A0), printer.dropped());
+  });
+
+}
+
+void loop() {
+  //Call Tweakly forever
+  TweaklyRun();
+  //Put Your Code Here :-)
+}
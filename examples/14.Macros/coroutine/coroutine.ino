@@ -0,0 +1,51 @@
+/*
+ * 
+ * COROUTINE EXAMPLE FOR TWEAKLY
+ * Created By Mirko Pacioni
+ * 
+ * A Coroutine is a task written as straight code that waits without blocking the loop.
+ * await_ms(milliseconds) waits for some time, await_event(pad, event) waits for a pad event,
+ * await_timer(timer) waits for the next dispatch of a TickTimer, await_until(condition) waits for a condition.
+ * Variables used across an await must be members of the coroutine class.
+ * 
+ */
+ #include "Tweakly.h"
+
+ //Create led Pad
+ Pad led(6);
+
+ //Create button Pad
+ Pad button(2, INPUT_PULLUP);
+
+ //Blink the led five times every time the button is clicked
+ class Blinker : public Coroutine {
+   uint8_t times;
+   void run() {
+     COROUTINE_BEGIN
+     while (true) {
+       await_event(button, CLICK);
+       for (times = 0; times < 10; times++) {
+         led.toggle();
+         await_ms(200);
+       }
+     }
+     COROUTINE_END
+   }
+ };
+
+ Blinker blinker;
+
+ void setup() {
+  
+  //Start serial
+  Serial.begin(115200);
+  
+ }
+ 
+ void loop() {
+  //Call Tweakly for ever, it resumes the coroutines
+  TweaklyRun();
+  
+  //Your code continues without interruption
+  //Put your code here :-)
+ }
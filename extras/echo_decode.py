@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+#
+#  ECHO BINARY DECODER FOR TWEAKLY
+#
+#  Turns a capture of an Echo in binary mode back into text.
+#  Phrases are found by scanning the sketch sources for Echo print() and
+#  ECHO_LOG() calls, and matched to records by the same FNV-1a id the
+#  library writes.
+#
+#  usage : echo_decode.py capture.bin sketch_folder_or_file [...]
+#          echo_decode.py /dev/ttyUSB0 sketch_folder --baud 115200   (needs pyserial)
+#
+
+import argparse
+import codecs
+import io
+import os
+import re
+import struct
+import sys
+
+RECORD_SYNC = 0xA5
+
+FORMAT_SIGNED = 0
+FORMAT_UNSIGNED = 1
+FORMAT_DOUBLE = 2
+FORMAT_CHAR = 3
+FORMAT_STRING = 4
+FORMAT_FLASH_STRING = 5
+
+SOURCE_EXTENSIONS = ('.ino', '.h', '.hpp', '.c', '.cpp')
+PHRASE_CALL = re.compile(r'(?:\.print\s*\(|ECHO_LOG\s*\([^,]+,)\s*((?:"(?:\\.|[^"\\])*"\s*)+)')
+STRING_LITERAL = re.compile(r'"((?:\\.|[^"\\])*)"')
+DIRECTIVE = re.compile(r'%([-+ 0]*)(\d*)(?:\.(\d+))?([lhz]*)([diuxXobpcsf%])')
+
+
+def phrase_id(phrase):
+    value = 2166136261
+    for byte in phrase.encode('latin-1'):
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def source_files(paths):
+    for path in paths:
+        if os.path.isdir(path):
+            for root, _, files in os.walk(path):
+                for name in sorted(files):
+                    if name.endswith(SOURCE_EXTENSIONS):
+                        yield os.path.join(root, name)
+        else:
+            yield path
+
+
+def load_phrases(paths):
+    phrases = {}
+    for path in source_files(paths):
+        with open(path, encoding='latin-1') as source:
+            text = source.read()
+        for call in PHRASE_CALL.finditer(text):
+            literal = ''.join(STRING_LITERAL.findall(call.group(1)))
+            phrase = codecs.decode(literal, 'unicode_escape')
+            phrases[phrase_id(phrase)] = phrase
+    return phrases
+
+
+def format_phrase(phrase, args):
+    # Same directives as tweaklystring::_format, applied to the decoded arguments
+    values = iter(args)
+
+    def directive(match):
+        flags, width, precision, length, kind = match.groups()
+        if kind == '%':
+            return '%'
+        value = next(values, '')
+        if kind in 'uxXobp' and isinstance(value, int) and value < 0:
+            # Negative values are written as the bits of their type, older captures carry no size
+            bits = getattr(value, 'size', 0) * 8 or (64 if length.count('l') >= 2 else 32)
+            value &= (1 << bits) - 1
+        if kind == 'p':
+            text = '0x%x' % value
+            return text.ljust(int(width or 0)) if '-' in flags else text.rjust(int(width or 0))
+        if kind == 'b':
+            text = format(int(value), 'b')
+            return text.rjust(int(width or 0), '0' if '0' in flags else ' ')
+        spec = '%' + flags + width + ('.' + precision if precision is not None else '') + kind
+        if kind in 'diuxXo':
+            value = int(value)
+            spec = spec.replace('u', 'd')
+        elif kind == 'c' and isinstance(value, int):
+            value = chr(value)
+        elif kind == 'f':
+            value = float(value)
+        return spec % value
+
+    return DIRECTIVE.sub(directive, phrase)
+
+
+class SizedInt(int):
+    # A signed argument with the size in bytes of its type on the board
+    size = 0
+
+
+class Reader:
+
+    def __init__(self, stream):
+        self.stream = stream
+        self.pending = b''
+
+    def unread(self, data):
+        self.pending = data + self.pending
+
+    def byte(self):
+        return self.bytes(1)[0]
+
+    def bytes(self, count):
+        data, self.pending = self.pending[:count], self.pending[count:]
+        while len(data) < count:
+            chunk = self.stream.read(count - len(data))
+            if not chunk:
+                raise EOFError
+            data += chunk
+        return data
+
+    def varint(self):
+        value, shift = 0, 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if byte < 0x80:
+                return value
+
+    def argument(self):
+        kind = self.byte()
+        size, kind = kind >> 4, kind & 0x0F
+        if kind == FORMAT_SIGNED:
+            value = self.varint()
+            value = SizedInt((value >> 1) ^ -(value & 1))
+            value.size = size
+            return value
+        if kind == FORMAT_UNSIGNED:
+            return self.varint()
+        if kind == FORMAT_DOUBLE:
+            return struct.unpack('<f', self.bytes(4))[0]
+        if kind == FORMAT_CHAR:
+            return chr(self.byte())
+        if kind in (FORMAT_STRING, FORMAT_FLASH_STRING):
+            return self.bytes(self.byte()).decode('latin-1')
+        raise ValueError('unknown argument type %d' % kind)
+
+
+def parse_record(body):
+    # A record is valid when its arguments fill exactly the length it announced
+    if len(body) < 9:
+        return None
+    record_id, timestamp, count = struct.unpack('<IIB', body[:9])
+    reader = Reader(io.BytesIO(body[9:]))
+    try:
+        args = [reader.argument() for _ in range(count)]
+    except (ValueError, EOFError):
+        return None
+    if reader.stream.read(1):
+        return None
+    return record_id, timestamp, args
+
+
+def decode(stream, phrases, output):
+    reader = Reader(stream)
+    try:
+        while True:
+            if reader.byte() != RECORD_SYNC:
+                continue
+            length = reader.byte()
+            body = reader.bytes(length)
+            record = parse_record(body)
+            if record is None:
+                # A sync byte inside a payload, or a damaged record : look for the next sync after it
+                reader.unread(bytes([length]) + body)
+                continue
+            record_id, timestamp, args = record
+            phrase = phrases.get(record_id)
+            if phrase is None:
+                text = '<unknown phrase %08x> %s' % (record_id, ' '.join(str(arg) for arg in args))
+            else:
+                text = format_phrase(phrase, args).rstrip('\r\n')
+            output.write('%10u  %s\n' % (timestamp, text))
+            output.flush()
+    except EOFError:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode binary Echo captures into text')
+    parser.add_argument('capture', help='capture file, or serial port with --baud')
+    parser.add_argument('sources', nargs='+', help='sketch folders or files holding the phrases')
+    parser.add_argument('--baud', type=int, help='read from a serial port at this baud rate')
+    options = parser.parse_args()
+
+    phrases = load_phrases(options.sources)
+    if options.baud:
+        import serial
+        stream = serial.Serial(options.capture, options.baud)
+    else:
+        stream = open(options.capture, 'rb')
+    with stream:
+        decode(stream, phrases, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,215 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * VIRTUAL ARDUINO FOR THE TWEAKLY REPLAY HARNESS
+ *
+ * Just enough of the Arduino core to build Tweakly and a sketch on a computer :
+ * millis() and micros() read a virtual clock, pins and analog inputs hold the values
+ * set by the scenario, attached interrupts fire when the scenario changes a pin,
+ * and tone()/noTone() are recorded like any callback of the sketch.
+ *
+ */
+
+#ifndef REPLAY_ARDUINO_H
+#define REPLAY_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define NOT_AN_INTERRUPT -1
+#define REPLAY_PINS 64
+
+// Level of every pin when the board starts, before the sketch builds its objects
+#ifndef REPLAY_IDLE_LEVEL
+  #define REPLAY_IDLE_LEVEL HIGH
+#endif
+
+#define PROGMEM
+#define IRAM_ATTR
+class __FlashStringHelper;
+#define F(_string) (reinterpret_cast<const __FlashStringHelper *>(_string))
+#define pgm_read_byte(_address) (*(const uint8_t *)(_address))
+#define pgm_read_word(_address) (*(const uint16_t *)(_address))
+#define pgm_read_dword(_address) (*(const uint32_t *)(_address))
+#define pgm_read_ptr(_address) (*(void * const *)(_address))
+#define digitalPinToInterrupt(_pin) ((_pin) < REPLAY_PINS ? (_pin) : NOT_AN_INTERRUPT)
+#define bitRead(_value, _bit) (((_value) >> (_bit)) & 0x01)
+#define lowByte(_value) ((uint8_t)((_value) & 0xff))
+#define highByte(_value) ((uint8_t)((_value) >> 8))
+
+namespace replay {
+
+    typedef void (*_replay_isr)();
+
+    // State of the virtual board
+    unsigned long _now_micros = 0;
+    int _pin_levels[REPLAY_PINS];
+    int _analog_values[REPLAY_PINS];
+    unsigned long _pulse_micros[REPLAY_PINS];
+    _replay_isr _isr[REPLAY_PINS];
+    int _isr_mode[REPLAY_PINS];
+    bool _interrupts_enabled = true;
+
+    struct _replay_boot {
+      _replay_boot() {
+        for (int i = 0; i < REPLAY_PINS; i++){
+          _pin_levels[i] = REPLAY_IDLE_LEVEL;
+        }
+      }
+    } _boot;
+
+    // Every recorded callback goes through this, the harness sets it
+    void (*_record)(const char *, long) = NULL;
+
+    void log(const char *_name, long _value = 0) {
+      if (_record != NULL){
+        _record(_name, _value);
+      }
+    }
+
+    // Change a pin, and call the interrupt attached to it when the edge matches
+    void setPin(uint8_t _pin, int _level) {
+      if (_pin >= REPLAY_PINS){
+        return;
+      }
+      int _previous = _pin_levels[_pin];
+      _pin_levels[_pin] = _level ? HIGH : LOW;
+      if (_isr[_pin] != NULL && _interrupts_enabled && _previous != _pin_levels[_pin]){
+        if (_isr_mode[_pin] == CHANGE || (_isr_mode[_pin] == RISING && _pin_levels[_pin] == HIGH) || (_isr_mode[_pin] == FALLING && _pin_levels[_pin] == LOW)){
+          _isr[_pin]();
+        }
+      }
+    }
+
+}
+
+inline unsigned long millis() { return replay::_now_micros / 1000; }
+inline unsigned long micros() { return replay::_now_micros; }
+inline void delay(unsigned long _ms) { replay::_now_micros += _ms * 1000; }
+inline void delayMicroseconds(unsigned int _us) { replay::_now_micros += _us; }
+inline void yield() { }
+
+inline void pinMode(uint8_t, uint8_t) { }
+inline int digitalRead(uint8_t _pin) { return _pin < REPLAY_PINS ? replay::_pin_levels[_pin] : LOW; }
+inline void digitalWrite(uint8_t _pin, uint8_t _level) { if (_pin < REPLAY_PINS) replay::_pin_levels[_pin] = _level ? HIGH : LOW; }
+inline int analogRead(uint8_t _pin) { return _pin < REPLAY_PINS ? replay::_analog_values[_pin] : 0; }
+inline void analogWrite(uint8_t, int) { }
+inline void analogReadResolution(int) { }
+
+// pulseIn returns the echo set by the scenario and takes its time
+inline unsigned long pulseIn(uint8_t _pin, uint8_t, unsigned long _timeout = 1000000UL) {
+  unsigned long _pulse = _pin < REPLAY_PINS ? replay::_pulse_micros[_pin] : 0;
+  if (_pulse == 0 || _pulse > _timeout){
+    replay::_now_micros += _timeout;
+    return 0;
+  }
+  replay::_now_micros += _pulse;
+  return _pulse;
+}
+
+inline void tone(uint8_t _pin, unsigned int _frequency, unsigned long = 0) { replay::log("tone", ((long)_pin << 16) | _frequency); }
+inline void noTone(uint8_t _pin) { replay::log("noTone", _pin); }
+
+inline void attachInterrupt(int _pin, void (*_isr)(), int _mode) {
+  if (_pin >= 0 && _pin < REPLAY_PINS){
+    replay::_isr[_pin] = _isr;
+    replay::_isr_mode[_pin] = _mode;
+  }
+}
+inline void detachInterrupt(int _pin) { if (_pin >= 0 && _pin < REPLAY_PINS) replay::_isr[_pin] = NULL; }
+inline void noInterrupts() { replay::_interrupts_enabled = false; }
+inline void interrupts() { replay::_interrupts_enabled = true; }
+
+inline long random(long _max) { return _max > 0 ? rand() % _max : 0; }
+inline long random(long _min, long _max) { return _max > _min ? _min + rand() % (_max - _min) : _min; }
+inline long map(long _x, long _in_min, long _in_max, long _out_min, long _out_max) { return (_x - _in_min) * (_out_max - _out_min) / (_in_max - _in_min) + _out_min; }
+
+class String {
+  std::string _text;
+  public :
+  String(const char *_chars = "") : _text(_chars) { }
+  const char *c_str() const { return _text.c_str(); }
+  unsigned int length() const { return _text.size(); }
+};
+
+class Print {
+  public :
+  virtual ~Print() { }
+  virtual size_t write(uint8_t _c) = 0;
+  virtual size_t write(const uint8_t *_buffer, size_t _size) { size_t _written = 0; while (_size--) _written += write(*_buffer++); return _written; }
+  virtual int availableForWrite() { return 0; }
+  size_t write(const char *_text) { return write((const uint8_t *)_text, strlen(_text)); }
+  size_t print(const char *_text) { return write(_text); }
+  size_t print(const __FlashStringHelper *_text) { return write((const char *)_text); }
+  size_t print(const String &_text) { return write(_text.c_str()); }
+  size_t print(char _c) { return write((uint8_t)_c); }
+  size_t print(long _value) { char _b[24]; snprintf(_b, sizeof(_b), "%ld", _value); return write(_b); }
+  size_t print(unsigned long _value) { char _b[24]; snprintf(_b, sizeof(_b), "%lu", _value); return write(_b); }
+  size_t print(int _value) { return print((long)_value); }
+  size_t print(unsigned int _value) { return print((unsigned long)_value); }
+  size_t print(double _value, int _digits = 2) { char _b[32]; snprintf(_b, sizeof(_b), "%.*f", _digits, _value); return write(_b); }
+  template <typename _type> size_t println(_type _value) { size_t _written = print(_value); return _written + write("\n"); }
+  size_t println() { return write("\n"); }
+};
+
+class Stream : public Print {
+  public :
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+// Serial keeps what the sketch prints, the harness shows it with --serial
+class ReplaySerial : public Stream {
+  public :
+  std::string text;
+  void begin(long) { }
+  size_t write(uint8_t _c) { text += (char)_c; return 1; }
+  using Print::write;
+  int availableForWrite() { return 64; }
+  operator bool() { return true; }
+};
+
+ReplaySerial Serial;
+
+#endif
@@ -0,0 +1,293 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * REPLAY HARNESS FOR TWEAKLY
+ *
+ * Runs a sketch on a computer in virtual time and checks the callbacks it makes
+ * against golden traces, so pad timings, timer priorities and coroutines can be
+ * verified without a board. Every scenario runs in its own process, from a freshly
+ * built sketch, so thousands of them take about a second.
+ *
+ * The sketch has setup() and loop() as on the board, and its callbacks report with
+ * replay::log("name", value). tone() and noTone() are reported on their own.
+ *
+ *   g++ -std=gnu++11 -I extras/replay -I src -DREPLAY_SKETCH='"my_sketch.h"' extras/replay/replay.cpp -o replay
+ *   ./replay scenarios.txt            -> PASS/FAIL for each scenario, exit code 1 when one fails
+ *   ./replay --record scenarios.txt   -> the scenarios again, with the expect lines of this run
+ *   ./replay --serial scenarios.txt   -> also print what the sketch wrote to Serial
+ *
+ * A scenario file holds any number of scenarios, times are in milliseconds :
+ *
+ *   scenario click             start a scenario, the sketch is built again from scratch
+ *   step 1000                  microseconds between two loop(), 1000 when missing
+ *   pin 4 0                    set a digital pin, attached interrupts fire on the edge
+ *   analog 14 512              set the value analogRead returns for a pin
+ *   pulse 7 580                set the echo pulseIn measures on a pin, in microseconds
+ *   at 120                     call loop() until millis() reaches 120
+ *   expect 80 click 0          a callback expected at 80ms, with its value
+ *   # comment                  kept by --record with the scenario after it
+ *
+ * Pins start at REPLAY_IDLE_LEVEL, HIGH unless it is defined on the command line.
+ * sketch.h and scenarios.txt next to this file are the checks run on every push.
+ *
+ */
+
+#include "Arduino.h"
+
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#ifndef REPLAY_SKETCH
+  #error "Build the harness with -DREPLAY_SKETCH='\"path/to/sketch.h\"'"
+#endif
+
+#include REPLAY_SKETCH
+
+// Commands of a scenario
+#define REPLAY_STEP 0
+#define REPLAY_PIN 1
+#define REPLAY_ANALOG 2
+#define REPLAY_PULSE 3
+#define REPLAY_AT 4
+
+struct _replay_command {
+  uint8_t        _type;
+  unsigned long  _a;
+  long           _b;
+};
+
+struct _replay_event {
+  unsigned long  _millis;
+  std::string    _name;
+  long           _value;
+};
+
+struct _replay_scenario {
+  std::string                   _name;
+  std::vector<std::string>      _lines;
+  std::vector<_replay_command>  _commands;
+  std::vector<_replay_event>    _expected;
+};
+
+std::vector<_replay_event> _replay_captured;
+
+void _replay_capture(const char *_name, long _value) {
+  _replay_event _event = { millis(), _name, _value };
+  _replay_captured.push_back(_event);
+}
+
+// Read every scenario of a file, false on a line that is not understood
+bool _replay_parse(const char *_path, std::vector<_replay_scenario> &_scenarios) {
+  FILE *_file = fopen(_path, "r");
+  if (_file == NULL){
+    fprintf(stderr, "replay: cannot open %s\n", _path);
+    return false;
+  }
+  char _line[256];
+  unsigned int _line_number = 0;
+  // Comments and blank lines belong to the scenario after them
+  std::vector<std::string> _comments;
+  while (fgets(_line, sizeof(_line), _file) != NULL){
+    _line_number++;
+    _line[strcspn(_line, "\r\n")] = '\0';
+    char _word[64], _name[64];
+    unsigned long _a = 0;
+    long _b = 0;
+    if (sscanf(_line, " %63s", _word) != 1 || _word[0] == '#'){
+      _comments.push_back(_line);
+      continue;
+    }
+    if (strcmp(_word, "scenario") == 0 && sscanf(_line, " %*s %63s", _name) == 1){
+      _replay_scenario _scenario;
+      _scenario._name = _name;
+      _scenario._lines = _comments;
+      _scenario._lines.push_back(_line);
+      _scenarios.push_back(_scenario);
+      _comments.clear();
+      continue;
+    }
+    if (_scenarios.empty()){
+      fprintf(stderr, "replay: %s:%u : '%s' before the first scenario\n", _path, _line_number, _word);
+      fclose(_file);
+      return false;
+    }
+    _replay_scenario &_scenario = _scenarios.back();
+    _replay_command _command = { 0, 0, 0 };
+    if (strcmp(_word, "expect") == 0 && sscanf(_line, " %*s %lu %63s %ld", &_a, _name, &_b) >= 2){
+      _replay_event _event = { _a, _name, _b };
+      _scenario._expected.push_back(_event);
+      continue;
+    } else if (strcmp(_word, "step") == 0 && sscanf(_line, " %*s %lu", &_a) == 1 && _a > 0){
+      _command._type = REPLAY_STEP;
+    } else if (strcmp(_word, "pin") == 0 && sscanf(_line, " %*s %lu %ld", &_a, &_b) == 2){
+      _command._type = REPLAY_PIN;
+    } else if (strcmp(_word, "analog") == 0 && sscanf(_line, " %*s %lu %ld", &_a, &_b) == 2){
+      _command._type = REPLAY_ANALOG;
+    } else if (strcmp(_word, "pulse") == 0 && sscanf(_line, " %*s %lu %ld", &_a, &_b) == 2){
+      _command._type = REPLAY_PULSE;
+    } else if (strcmp(_word, "at") == 0 && sscanf(_line, " %*s %lu", &_a) == 1){
+      _command._type = REPLAY_AT;
+    } else {
+      fprintf(stderr, "replay: %s:%u : cannot read '%s'\n", _path, _line_number, _line);
+      fclose(_file);
+      return false;
+    }
+    _command._a = _a;
+    _command._b = _b;
+    _scenario._commands.push_back(_command);
+    _scenario._lines.insert(_scenario._lines.end(), _comments.begin(), _comments.end());
+    _scenario._lines.push_back(_line);
+    _comments.clear();
+  }
+  if (!_scenarios.empty()){
+    _scenarios.back()._lines.insert(_scenarios.back()._lines.end(), _comments.begin(), _comments.end());
+  }
+  fclose(_file);
+  return true;
+}
+
+// Run a scenario on the sketch of this process, returns the exit code of the process
+int _replay_run(const _replay_scenario &_scenario, bool _record_mode, bool _serial) {
+  unsigned long _step_micros = 1000;
+  replay::_record = _replay_capture;
+  srand(1);
+  setup();
+  for (size_t i = 0; i < _scenario._commands.size(); i++){
+    const _replay_command &_command = _scenario._commands[i];
+    switch (_command._type){
+      case REPLAY_STEP :
+        _step_micros = _command._a;
+      break;
+      case REPLAY_PIN :
+        replay::setPin(_command._a, _command._b);
+      break;
+      case REPLAY_ANALOG :
+        if (_command._a < REPLAY_PINS){
+          replay::_analog_values[_command._a] = _command._b;
+        }
+      break;
+      case REPLAY_PULSE :
+        if (_command._a < REPLAY_PINS){
+          replay::_pulse_micros[_command._a] = _command._b;
+        }
+      break;
+      case REPLAY_AT :
+        while (millis() < _command._a){
+          replay::_now_micros += _step_micros;
+          loop();
+        }
+      break;
+    }
+  }
+  if (_serial && !Serial.text.empty()){
+    printf("--- %s serial\n%s", _scenario._name.c_str(), Serial.text.c_str());
+  }
+  if (_record_mode){
+    size_t _lines = _scenario._lines.size();
+    while (_lines > 0 && _scenario._lines[_lines - 1].find_first_not_of(" \t") == std::string::npos){
+      _lines--;
+    }
+    for (size_t i = 0; i < _lines; i++){
+      printf("%s\n", _scenario._lines[i].c_str());
+    }
+    for (size_t i = 0; i < _replay_captured.size(); i++){
+      printf("expect %lu %s %ld\n", _replay_captured[i]._millis, _replay_captured[i]._name.c_str(), _replay_captured[i]._value);
+    }
+    return 0;
+  }
+  size_t _count = _replay_captured.size() > _scenario._expected.size() ? _replay_captured.size() : _scenario._expected.size();
+  for (size_t i = 0; i < _count; i++){
+    bool _has_expected = i < _scenario._expected.size();
+    bool _has_captured = i < _replay_captured.size();
+    const _replay_event *_expected = _has_expected ? &_scenario._expected[i] : NULL;
+    const _replay_event *_captured = _has_captured ? &_replay_captured[i] : NULL;
+    if (_expected == NULL || _captured == NULL || _expected->_millis != _captured->_millis || _expected->_name != _captured->_name || _expected->_value != _captured->_value){
+      printf("FAIL %s : callback %u\n", _scenario._name.c_str(), (unsigned int)i + 1);
+      if (_expected != NULL){
+        printf("  expected %lu %s %ld\n", _expected->_millis, _expected->_name.c_str(), _expected->_value);
+      } else {
+        printf("  expected nothing\n");
+      }
+      if (_captured != NULL){
+        printf("  got      %lu %s %ld\n", _captured->_millis, _captured->_name.c_str(), _captured->_value);
+      } else {
+        printf("  got      nothing\n");
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  bool _record_mode = false;
+  bool _serial = false;
+  std::vector<_replay_scenario> _scenarios;
+  for (int i = 1; i < argc; i++){
+    if (strcmp(argv[i], "--record") == 0){
+      _record_mode = true;
+    } else if (strcmp(argv[i], "--serial") == 0){
+      _serial = true;
+    } else if (!_replay_parse(argv[i], _scenarios)){
+      return 2;
+    }
+  }
+  if (_scenarios.empty()){
+    fprintf(stderr, "usage : %s [--record] [--serial] scenarios.txt [...]\n", argv[0]);
+    return 2;
+  }
+  struct timeval _start, _end;
+  gettimeofday(&_start, NULL);
+  unsigned int _passed = 0, _failed = 0;
+  for (size_t i = 0; i < _scenarios.size(); i++){
+    fflush(stdout);
+    pid_t _child = fork();
+    if (_child < 0){
+      perror("replay: fork");
+      return 2;
+    }
+    if (_child == 0){
+      int _result = _replay_run(_scenarios[i], _record_mode, _serial);
+      fflush(stdout);
+      _exit(_result);
+    }
+    int _status = 0;
+    waitpid(_child, &_status, 0);
+    if (WIFEXITED(_status) && WEXITSTATUS(_status) == 0){
+      _passed++;
+      if (!_record_mode){
+        printf("PASS %s\n", _scenarios[i]._name.c_str());
+      }
+    } else {
+      _failed++;
+      if (!WIFEXITED(_status)){
+        printf("FAIL %s : the sketch crashed\n", _scenarios[i]._name.c_str());
+      }
+    }
+  }
+  if (!_record_mode){
+    gettimeofday(&_end, NULL);
+    printf("%u passed, %u failed, %.3f s\n", _passed, _failed, (_end.tv_sec - _start.tv_sec) + (_end.tv_usec - _start.tv_usec) / 1000000.0);
+  }
+  return _failed > 0 ? 1 : 0;
+}
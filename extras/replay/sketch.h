@@ -0,0 +1,68 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * SKETCH OF THE REPLAY SCENARIOS
+ *
+ * A button with click, double click and long press, two timers that rotate,
+ * a coroutine waiting for the button and a rollup with sleep_for.
+ * scenarios.txt holds the traces recorded from it :
+ *
+ *   g++ -std=gnu++11 -I extras/replay -I src -DREPLAY_SKETCH='"sketch.h"' extras/replay/replay.cpp -o replay
+ *   ./replay extras/replay/scenarios.txt
+ *
+ */
+
+#include "Tweakly.h"
+
+Pad button(4, INPUT_PULLUP);
+TickTimer fast;
+TickTimer slow;
+
+// Counts the clicks, and answers each one 100ms later
+class Answer : public Coroutine {
+  uint8_t clicks;
+  void run() {
+    COROUTINE_BEGIN
+    for (clicks = 1; ; clicks++) {
+      await_event(button, CLICK);
+      replay::log("co_click", clicks);
+      await_ms(100);
+      replay::log("co_answer", clicks);
+    }
+    COROUTINE_END
+  }
+} answer;
+
+void setup() {
+  button.onEvent(CLICK, [](){ replay::log("click"); });
+  button.onEvent(DOUBLE_CLICK, [](){ replay::log("double"); });
+  button.onEvent(LONG_PRESS, [](){ replay::log("long"); });
+  fast.attach(250, [](){ replay::log("fast"); });
+  slow.attach(600, [](){ replay::log("slow"); });
+}
+
+void loop() {
+  TweaklyRun();
+  TWEAKLY_ROLLUP
+    sleep_for(1000);
+    replay::log("rollup");
+  END_ROLLUP
+}
@@ -52,6 +52,11 @@ using namespace std;
 #endif
 
 //Include core libs
+#include "core/trace.h"
+#include "core/run.h"
+#include "core/monitor.h"
+#include "core/events.h"
+#include "core/storage.h"
 #include "core/pads.h"
 #include "core/timers.h"
 #include "core/polyphonic.h"
@@ -67,6 +72,11 @@ using namespace tweaklyclock;
 using namespace tweaklystring;
 using namespace tweaklynumbers;
 using namespace asyncer;
+using namespace tweaklytrace;
+using namespace tweaklyevents;
+using namespace tweaklyrun;
+using namespace tweaklymonitor;
+using namespace tweaklystorage;
 
 //Include peripherals libs
 #include "peripherals/sonar.h"
@@ -81,32 +91,12 @@ using namespace encoder;
 // Enablers
 volatile bool _tweakly_ready { false };
 
-// TweaklyRun: run the core; must be called in loop
+// TweaklyRun: run the modules; must be called in loop
 void TweaklyRun(){
-  if (!_tweakly_ready){
-    //core
-    tweaklypads::Setup();
-    tweaklyticktimers::Setup();
-    tweaklypolyphonic::Setup();
-    tweaklyclock::Setup();
-    //peripherals
-    sonar::Setup();
-    encoder::Setup();
-    //Tweakly statements
-    asyncer::Setup();
-    _tweakly_ready = true;
-  } else {
-    //core
-    tweaklypads::Loop();
-    tweaklyticktimers::Loop();
-    tweaklypolyphonic::Loop();
-    tweaklyclock::Loop();
-    //peripherals
-    sonar::Loop();
-    encoder::Loop(); 
-    //Tweakly statements
-    asyncer::Loop();
-  }
+  unsigned long _run_start_micros = tweaklymonitor::_monitor_begin();
+  tweaklyrun::Loop();
+  _tweakly_ready = true;
+  tweaklymonitor::_monitor_end(_run_start_micros);
 }
 
 #endif
@@ -36,103 +36,321 @@
 
 namespace dolist {
 
-   //Variables
-   unsigned long _lists_counter = 0;
-   
    //Type definition 
    typedef void (*_list_callback)();
+   typedef _list_callback doTask;
+   typedef bool (*_list_predicate)();
 
-   //Enablers
-   volatile bool _list_exists  { false };
+   // Tasks a doList holds, define it before including Tweakly.h for longer lists
+   #ifndef DOLIST_MAX_TASKS
+   #define DOLIST_MAX_TASKS 8
+   #endif
+   static_assert(DOLIST_MAX_TASKS <= 255, "a doList holds at most 255 tasks");
 
-   // Struct required for lists
-   struct _lists{
-      uint16_t       _list_index;
-      int            _functions_counter;
-      _list_callback _function_callback;
-      _lists *       _next_function = NULL;
+   // Playback of a pipeline
+   #define PIPELINE_LOOP 0                    // -> after the last step it starts again from the first
+   #define PIPELINE_ONCE 1                    // -> it stops after the last step
+   #define PIPELINE_PING_PONG 2               // -> it goes back and forth between the first and the last step
+
+   // Enablers
+   volatile bool _pipeline_exists { false };
+
+   // Timing of a pipeline step
+   struct doStepStats {
+     unsigned int runs;                       // -> how many times the step ran
+     unsigned long lastMillis;                // -> time spent on the step the last time, dwell or predicate included
+     unsigned long maxMillis;                 // -> longest time spent on the step
+     unsigned long taskMicros;                // -> duration of the task the last time it ran
+   };
+
+   // Struct required for pipeline steps
+   struct _list_step {
+     unsigned long  _step_dwell;
+     _list_predicate _step_done;
+     doStepStats    _step_stats;
    };
 
-   _lists *_first_function = NULL; 
-   _lists *_last_function = NULL;
-   
-   //Class for doList
+   // Steps of a pipeline, taken from the storage when a list first plays or gets a step
+   struct _list_steps {
+     _list_step _step[DOLIST_MAX_TASKS];
+   };
+   tweaklystorage::_records<_list_steps, TWEAKLY_STATIC_PIPELINES> _steps_storage;
+
+   class doList;
+   doList *_first_pipeline = NULL, *_last_pipeline = NULL;
+
+   //Class for doList : the tasks of a list live in its own array of DOLIST_MAX_TASKS, next and back jump straight to them,
+   //addTask ignores any further task; a table list holds at most 255 tasks and plays at most DOLIST_MAX_TASKS steps
    class doList {
      private :
-     uint16_t _list_position;
-     int      _list_function_position_counter;
-     int      _functions_counter;
+     union {
+       _list_callback         _tasks[DOLIST_MAX_TASKS];
+       const _list_callback * _table;
+     };
+     bool                   _from_table;
+     bool                   _table_in_flash;
+     uint8_t                _functions_counter;
+     uint8_t                _list_function_position_counter;
+     _list_steps *          _steps;
+     uint8_t                _pipeline_mode;
+     bool                   _pipeline_playing;
+     bool                   _pipeline_backwards;
+     bool                   _pipeline_registered;
+     unsigned long          _step_start_millis;
+     doList *               _next_pipeline;
+     friend void Loop();
+     void _init_pipeline() {
+       _steps = NULL;
+       _pipeline_mode = PIPELINE_LOOP;
+       _pipeline_playing = false;
+       _pipeline_backwards = false;
+       _pipeline_registered = false;
+       _step_start_millis = 0;
+       _next_pipeline = NULL;
+     }
+     // False when the list has more steps than DOLIST_MAX_TASKS or the storage has no steps left
+     bool _make_steps() {
+       if (this->_steps == NULL && this->_functions_counter <= DOLIST_MAX_TASKS){
+         this->_steps = _steps_storage.take();
+         if (this->_steps != NULL){
+           memset(this->_steps, 0, sizeof(_list_steps));
+         }
+       }
+       return this->_steps != NULL;
+     }
+     void _run_step();
+     void _advance();
+     _list_callback _task(uint8_t _index) {
+       if (!this->_from_table){
+         return this->_tasks[_index];
+       }
+       #if defined(__AVR__)
+       if (this->_table_in_flash){
+         return (_list_callback)pgm_read_ptr(&this->_table[_index]);
+       }
+       #endif
+       return this->_table[_index];
+     }
      public :
      doList() {
-       _list_position = _lists_counter++;
-       _list_function_position_counter = 0;
+       _from_table = false;
+       _table_in_flash = false;
        _functions_counter = 0;
+       _list_function_position_counter = 0;
+       _init_pipeline();
+     }
+     // List over a constant table of tasks, that stays in flash : pass true when it is declared PROGMEM
+     template <size_t _table_size>
+     doList(const _list_callback (&_new_table)[_table_size], bool _in_flash = false) {
+       static_assert(_table_size <= 255, "a doList holds at most 255 tasks");
+       _table = _new_table;
+       _from_table = true;
+       _table_in_flash = _in_flash;
+       _functions_counter = _table_size;
+       _list_function_position_counter = 0;
+       _init_pipeline();
      }
+     // A list is registered by address while it plays and owns its steps : it cannot be copied
+     doList(const doList &) = delete;
+     doList &operator=(const doList &) = delete;
+     ~doList();
      void addTask(_list_callback _function);
+     void addTask(_list_callback _function, unsigned long _dwell, _list_predicate _done);
+     void setStep(uint8_t _index, unsigned long _dwell, _list_predicate _done);
+     void play(uint8_t _mode);
+     void pause();
+     bool playing();
+     uint8_t step();
+     doStepStats stepStats(uint8_t _index);
      void next();
      void back();
-     //operator "++"
-     doList operator++(int) {
+     //operator "++" : the list itself, it cannot be copied
+     doList &operator++(int) {
        this->next();
        return *this;
      }
-     doList operator--(int) {
+     doList &operator--(int) {
        this->back();
        return *this;
      }
    };
 
+   // Destructor : a playing list leaves TweaklyRun, heap steps are given back (static ones stay taken)
+   doList::~doList(){
+     if (this->_pipeline_registered){
+       doList *_previous = NULL;
+       for (doList *_this_list = _first_pipeline; _this_list != NULL; _this_list = _this_list->_next_pipeline){
+         if (_this_list == this){
+           if (_previous == NULL){
+             _first_pipeline = this->_next_pipeline;
+           } else {
+             _previous->_next_pipeline = this->_next_pipeline;
+           }
+           if (_last_pipeline == this){
+             _last_pipeline = _previous;
+           }
+           break;
+         }
+         _previous = _this_list;
+       }
+     }
+     #if TWEAKLY_STATIC_PIPELINES == 0
+     delete this->_steps;
+     #endif
+   }
+
    // addTask Function : add tasks to the list
    void doList::addTask(_list_callback _function){
-     _lists *_new_function = new _lists;
-     _new_function->_list_index = this->_list_position;
-     _new_function->_function_callback = _function;
-     _new_function->_functions_counter = this->_functions_counter++;
-     if (_first_function == NULL){
-       _first_function = _new_function;
-     }else{
-       _last_function->_next_function= _new_function;
-     }
-     _last_function = _new_function;
-     if (!_list_exists){
-      _list_exists = true;
+     if (this->_from_table || this->_functions_counter == DOLIST_MAX_TASKS){
+       return;
      }
+     this->_tasks[this->_functions_counter++] = _function;
+    }
+
+    // addTask Function : add a pipeline step, it lasts at least _dwell milliseconds and until _done returns true
+    void doList::addTask(_list_callback _function, unsigned long _dwell, _list_predicate _done = NULL){
+      this->addTask(_function);
+      this->setStep(this->_functions_counter - 1, _dwell, _done);
+    }
+
+    // setStep Function : timing of a step when the list plays as a pipeline
+    void doList::setStep(uint8_t _index, unsigned long _dwell, _list_predicate _done = NULL){
+      if (_index >= this->_functions_counter || !this->_make_steps()){
+        return;
+      }
+      this->_steps->_step[_index]._step_dwell = _dwell;
+      this->_steps->_step[_index]._step_done = _done;
+    }
+
+    // play Function : TweaklyRun runs the steps by itself, from the current one
+    void doList::play(uint8_t _mode = PIPELINE_LOOP){
+      if (this->_functions_counter == 0 || !this->_make_steps()){
+        return;
+      }
+      if (!this->_pipeline_registered){
+        this->_pipeline_registered = true;
+        if (_first_pipeline == NULL){
+          _first_pipeline = this;
+        }else{
+          _last_pipeline->_next_pipeline = this;
+        }
+        _last_pipeline = this;
+      }
+      this->_pipeline_mode = _mode;
+      this->_pipeline_backwards = false;
+      this->_pipeline_playing = true;
+      this->_run_step();
+      if (!_pipeline_exists){
+        _pipeline_exists = true;
+      }
+    }
+
+    // pause Function : the pipeline stays on its current step
+    void doList::pause(){
+      this->_pipeline_playing = false;
+    }
+
+    // playing Function : true while the pipeline runs, false when paused or at the end of a PIPELINE_ONCE
+    bool doList::playing(){
+      return this->_pipeline_playing;
+    }
+
+    // step Function : index of the current task
+    uint8_t doList::step(){
+      return this->_list_function_position_counter;
+    }
+
+    // stepStats Function : timing of a pipeline step
+    doStepStats doList::stepStats(uint8_t _index){
+      doStepStats _stats = { 0, 0, 0, 0 };
+      if (this->_steps != NULL && _index < this->_functions_counter){
+        _stats = this->_steps->_step[_index]._step_stats;
+      }
+      return _stats;
+    }
+
+    // Run the task of the current step and start timing it
+    void doList::_run_step(){
+      doStepStats *_stats = &this->_steps->_step[this->_list_function_position_counter]._step_stats;
+      unsigned long _task_start = micros();
+      this->_task(this->_list_function_position_counter)();
+      _stats->taskMicros = micros() - _task_start;
+      _stats->runs++;
+      this->_step_start_millis = millis();
+    }
+
+    // Leave the current step and run the following one, as the playback mode says
+    void doList::_advance(){
+      doStepStats *_stats = &this->_steps->_step[this->_list_function_position_counter]._step_stats;
+      _stats->lastMillis = millis() - this->_step_start_millis;
+      if (_stats->lastMillis > _stats->maxMillis){
+        _stats->maxMillis = _stats->lastMillis;
+      }
+      uint8_t _last = this->_functions_counter - 1;
+      if (this->_pipeline_mode == PIPELINE_PING_PONG && _last > 0){
+        if (this->_list_function_position_counter == _last){
+          this->_pipeline_backwards = true;
+        } else if (this->_list_function_position_counter == 0){
+          this->_pipeline_backwards = false;
+        }
+        this->_list_function_position_counter += this->_pipeline_backwards ? -1 : 1;
+      } else if (this->_list_function_position_counter >= _last){
+        this->_list_function_position_counter = 0;
+        if (this->_pipeline_mode == PIPELINE_ONCE){
+          this->_pipeline_playing = false;
+          return;
+        }
+      } else {
+        this->_list_function_position_counter++;
+      }
+      this->_run_step();
     }
 
-    // next Function : go to the next task
+    // next Function : run the current task and go to the next one
     void doList::next(){
-       if (_list_exists){
-         for (_lists *_this_function = _first_function; _this_function != NULL; _this_function = _this_function->_next_function){
-          if (this->_list_position == _this_function->_list_index){
-            if(_this_function->_functions_counter == this->_list_function_position_counter) {
-              _this_function->_function_callback();
-            }
-           }
-          }
+       if (this->_functions_counter > 0){
+          this->_task(this->_list_function_position_counter)();
           this->_list_function_position_counter++;
-          if(this->_list_function_position_counter > this->_functions_counter - 1) {
+          if(this->_list_function_position_counter >= this->_functions_counter) {
             this->_list_function_position_counter = 0;
           }
       } 
     }
     
-    // back Functions : go to the previous task
+    // back Functions : run the current task and go to the previous one
     void doList::back(){
-       if (_list_exists){
-         for (_lists *_this_function = _first_function; _this_function != NULL; _this_function = _this_function->_next_function){
-          if (this->_list_position == _this_function->_list_index){
-            if(_this_function->_functions_counter == this->_list_function_position_counter) {
-              _this_function->_function_callback();
-            }
-           }
+       if (this->_functions_counter > 0){
+          this->_task(this->_list_function_position_counter)();
+          if(this->_list_function_position_counter == 0) {
+            this->_list_function_position_counter = this->_functions_counter;
           }
           this->_list_function_position_counter--;
-          if(this->_list_function_position_counter < 0) {
-            this->_list_function_position_counter = this->_functions_counter - 1;
+      }
+    }
+
+    // Loop for all pipelines : a step ends when its dwell time is over and its predicate, if any, is true
+    void Loop() {
+      if (_pipeline_exists){
+        unsigned long _current_millis = millis();
+        for (doList *_this_list = _first_pipeline; _this_list != NULL; _this_list = _this_list->_next_pipeline){
+          if (_this_list->_pipeline_playing){
+            _list_step *_this_step = &_this_list->_steps->_step[_this_list->_list_function_position_counter];
+            if ((unsigned long)(_current_millis - _this_list->_step_start_millis) >= _this_step->_step_dwell
+               && (_this_step->_step_done == NULL || _this_step->_step_done())){
+              _this_list->_advance();
+            }
           }
+        }
       }
     }
 
+    // Idle while no doList plays
+    bool _pipelines_idle() {
+      return !_pipeline_exists;
+    }
+
+    tweaklyrun::Module _pipelines_module("dolist", Loop, MODULE_ORDER_APPS, NULL, _pipelines_idle);
+
 }
 
 #endif
\ No newline at end of file
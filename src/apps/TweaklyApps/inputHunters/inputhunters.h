@@ -36,18 +36,35 @@ namespace inputhunters {
 
     // Type definition
     typedef void (*_hunter_callback)(int);
+    typedef void (*_hunter_context_callback)(void *, int);
 
     //Enablers
     volatile bool _hunter_exists { false };
 
-    //Class for inputHunters
+    // Pads an inputHunter can follow, one bit each; define it lower before including Tweakly.h to save RAM
+    #ifndef HUNTER_MAX_PADS
+    #define HUNTER_MAX_PADS 32
+    #endif
+    static_assert(HUNTER_MAX_PADS <= 32, "an inputHunter follows at most 32 pads");
+
+    //Class for inputHunters : watches the debounced levels of a pad class as a bitmask
     class inputHunter {
       private :
-      uint8_t _this_global_pads_status = 0;
-      uint8_t _this_current_pads_status = 0;
-      _hunter_callback _this_function;
-      const char* _this_class;
-      uint8_t _this_pad_number;
+      uint32_t _this_snapshot = 0;
+      unsigned int _this_levels_serial = 0;
+      tweaklyevents::_callable _this_function = tweaklyevents::_make_callable((_hunter_callback)NULL);
+      _pads * _this_pads[HUNTER_MAX_PADS];
+      uint8_t _this_pads_count = 0;
+      uint32_t _levels() {
+        uint32_t _mask = 0;
+        for (uint8_t i = 0; i < this->_this_pads_count; i++){
+          if (this->_this_pads[i]->_pad_debounced_status){
+            _mask |= (uint32_t)1 << i;
+          }
+        }
+        return _mask;
+      }
+      void _assign(const char* _class, const tweaklyevents::_callable &_function);
       public :
       inputHunter() {
        if(!_hunter_exists) {
@@ -55,39 +72,48 @@ namespace inputhunters {
        }
       }
       void assign(const char* _class, _hunter_callback _function);
+      void assign(const char* _class, _hunter_context_callback _function, void *_context);
       void recognition();
     };
 
     //Assign pin class and callback function a inputHunter
     void inputHunter::assign(const char* _class, _hunter_callback _function) {
+      this->_assign(_class, tweaklyevents::_make_callable(_function));
+    }
+
+    //Assign pin class and a callback function that also receives _context, so one function can serve many inputHunters
+    void inputHunter::assign(const char* _class, _hunter_context_callback _function, void *_context) {
+      this->_assign(_class, tweaklyevents::_make_callable(_function, _context));
+    }
+
+    //The input pads of the class are looked up once, here
+    void inputHunter::_assign(const char* _class, const tweaklyevents::_callable &_function) {
       if(_hunter_exists && _pad_exists){
-       this->_this_class = _class;
-       for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
-         if (_this_pad->_pad_mode != OUTPUT && strcmp(_this_pad->_pad_class,this->_this_class) == 0){
-          this->_this_global_pads_status = this->_this_global_pads_status + digitalRead(_this_pad->_pad_number);
-        }
+       this->_this_pads_count = 0;
+       for (_pads *_this_pad = _first_pad; _this_pad != NULL && this->_this_pads_count < HUNTER_MAX_PADS; _this_pad = _this_pad->_next_pad){
+         if (_this_pad->_pad_mode != OUTPUT && strcmp(_this_pad->_pad_class, _class) == 0){
+           this->_this_pads[this->_this_pads_count++] = _this_pad;
+         }
        }
+       this->_this_snapshot = this->_levels();
+       this->_this_levels_serial = _pad_levels_serial;
        this->_this_function = _function;
       }
     }
 
-    //Recognition input class status
+    //Recognition input class status : calls back once for every pad whose debounced level changed, in assign order
     void inputHunter::recognition() {
-      if(_hunter_exists && _pad_exists){
-        this->_this_current_pads_status = 0;
-        bool _current_status;
-        for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
-          if (_this_pad->_pad_mode != OUTPUT && strcmp(_this_pad->_pad_class,this->_this_class) == 0){
-            _current_status = digitalRead(_this_pad->_pad_number);
-            this->_this_current_pads_status = this->_this_current_pads_status + _current_status;
-            if(_current_status != _this_pad->_pad_old_status) {
-              this->_this_pad_number = _this_pad->_pad_number;
-            }
-          }
+      if(this->_this_levels_serial == _pad_levels_serial || this->_this_function._function == NULL) {
+        return;
+      }
+      this->_this_levels_serial = _pad_levels_serial;
+      uint32_t _current = this->_levels();
+      uint32_t _changed = _current ^ this->_this_snapshot;
+      this->_this_snapshot = _current;
+      for (uint8_t i = 0; _changed != 0; i++, _changed >>= 1){
+        if (_changed & 1){
+          tweaklyevents::_call_event(this->_this_function, EVENT_CALL_INT, this->_this_pads[i]->_pad_number);
         }
-       if(this->_this_current_pads_status != this->_this_global_pads_status) {
-         this->_this_function(this->_this_pad_number);
-       }
       }
     }
 
@@ -34,36 +34,547 @@
 
 namespace stream {
 
+    // Definitions for Echo overflow policy
+    #define ECHO_DROP 0                       // -> new bytes that do not fit are dropped
+    #define ECHO_OVERWRITE 1                  // -> the oldest bytes are dropped to make room
+    #define ECHO_BLOCK 2                      // -> the writer waits for the Stream, like an unbuffered Echo
+
+    // Bytes written on each pass to Streams that do not implement availableForWrite()
+    #define ECHO_DRAIN_CHUNK 16
+
+    // Binary records : ECHO_RECORD_SYNC, length of the rest, phrase id (4 bytes), micros() (4 bytes), arguments count, tagged arguments
+    #define ECHO_RECORD_SYNC 0xA5
+    #define ECHO_RECORD_COUNT 10
+    #define ECHO_RECORD_SIZE 64
+
+    // Text written to the ring of a binary Echo : ECHO_TEXT_SPAN, length, text; the header stays in the ring
+    #define ECHO_TEXT_SPAN 0x00
+    #define ECHO_RECORD_MAX_STRING 32
+
+    // Enablers
+    volatile bool _echo_exists { false };
+
+    // Phrase id written in binary records : FNV-1a of the phrase, the decoder hashes the sources the same way
+    constexpr uint32_t _phrase_id(const char *_phrase, uint32_t _hash = 2166136261UL) {
+      return *_phrase == '\0' ? _hash : _phrase_id(_phrase + 1, (_hash ^ (uint8_t)*_phrase) * 16777619UL);
+    }
+
+    uint32_t _phrase_id_now(const char *_phrase) {
+      uint32_t _hash = 2166136261UL;
+      while (*_phrase != '\0'){
+        _hash = (_hash ^ (uint8_t)*_phrase++) * 16777619UL;
+      }
+      return _hash;
+    }
+
+    // Holder that forces ECHO_LOG phrase ids to be computed by the compiler
+    template <uint32_t _id>
+    struct _echo_phrase {
+      static const uint32_t id = _id;
+    };
+
+    // Record builder for binary Echo output
+    class _echo_record {
+      private :
+      uint8_t _bytes[ECHO_RECORD_SIZE];
+      uint8_t _length;
+      bool    _full;
+      public :
+      _echo_record(uint32_t _id) : _length(0), _full(false) {
+        put(ECHO_RECORD_SYNC);
+        put(0);
+        put32(_id);
+        put32(micros());
+        put(0);
+      }
+      void put(uint8_t _byte) {
+        if (_length < ECHO_RECORD_SIZE){
+          _bytes[_length++] = _byte;
+        } else {
+          _full = true;
+        }
+      }
+      void put32(uint32_t _value) {
+        for (uint8_t i = 0; i < 4; i++){
+          put(_value >> (8 * i));
+        }
+      }
+      // Integers are written as LEB128 varints, signed ones zigzag encoded first
+      void putVarint(tweaklystring::_format_ulong _value) {
+        while (_value >= 0x80){
+          put((_value & 0x7F) | 0x80);
+          _value >>= 7;
+        }
+        put(_value);
+      }
+      // Whole arguments only : the first one that does not fit is left out, with every later one
+      void putArg(const tweaklystring::_format_arg &_arg) {
+        if (_full){
+          return;
+        }
+        uint8_t _start = _length;
+        // The size of a signed argument rides in the high nibble of its type
+        put(_arg._type == FORMAT_SIGNED ? _arg._type | _arg._size << 4 : _arg._type);
+        switch (_arg._type){
+          case FORMAT_SIGNED :
+            putVarint(((tweaklystring::_format_ulong)_arg._signed << 1) ^ (tweaklystring::_format_ulong)(_arg._signed < 0 ? -1 : 0));
+          break;
+          case FORMAT_UNSIGNED :
+            putVarint(_arg._unsigned);
+          break;
+          case FORMAT_DOUBLE : {
+            float _float = _arg._double;
+            uint32_t _raw;
+            memcpy(&_raw, &_float, 4);
+            put32(_raw);
+          }
+          break;
+          case FORMAT_CHAR :
+            put(_arg._char);
+          break;
+          case FORMAT_STRING :
+          case FORMAT_FLASH_STRING : {
+            uint8_t _count = 0;
+            while (_count < ECHO_RECORD_MAX_STRING){
+              char _c = _arg._type == FORMAT_FLASH_STRING ? pgm_read_byte(_arg._string + _count) : _arg._string[_count];
+              if (_c == '\0') { break; }
+              _count++;
+            }
+            put(_count);
+            for (uint8_t i = 0; i < _count; i++){
+              put(_arg._type == FORMAT_FLASH_STRING ? pgm_read_byte(_arg._string + i) : _arg._string[i]);
+            }
+          }
+          break;
+        }
+        if (_full){
+          _length = _start;
+        } else {
+          _bytes[ECHO_RECORD_COUNT]++;
+        }
+      }
+      const uint8_t *bytes() {
+        _bytes[1] = _length - 2;
+        return _bytes;
+      }
+      uint8_t length() {
+        return _length;
+      }
+    };
+
+    // Struct required for Echo buffers : a TX ring drained by TweaklyRun()
+    struct _echoes : public Print {
+      Stream *       _echo_stream = NULL;
+      uint8_t *      _echo_buffer = NULL;
+      size_t         _echo_size = 0;
+      size_t         _echo_head = 0;
+      size_t         _echo_tail = 0;
+      size_t         _echo_used = 0;
+      uint8_t        _echo_policy = ECHO_DROP;
+      bool           _echo_stream_reports_space = false;
+      unsigned long  _echo_dropped = 0;
+      bool           _echo_records = false;     // -> binary mode : the ring holds whole records and text spans, dropped and evicted whole
+      size_t         _echo_unit_left = 0;       // -> bytes still in the ring of the unit the Stream has started
+      bool           _echo_text_open = false;   // -> the newest unit is a text span that has not been started, text is added to it
+      size_t         _echo_text_header = 0;     // -> index of the header of that span
+      _echoes *      _next_echo = NULL;
+
+      // Room the Stream has now, ECHO_DRAIN_CHUNK for Streams that never report it
+      size_t _stream_space() {
+        int _space = _echo_stream->availableForWrite();
+        if (_space > 0){
+          _echo_stream_reports_space = true;
+          return _space;
+        }
+        return _echo_stream_reports_space ? 0 : ECHO_DRAIN_CHUNK;
+      }
+
+      // Length in the ring of the unit starting at _index : a record or a text span, both are two header bytes and a body
+      size_t _unit_length(size_t _index) {
+        return 2 + _echo_buffer[(_index + 1) % _echo_size];
+      }
+
+      // Make room for _length bytes by evicting the oldest whole units, false when they cannot fit
+      bool _evict_units(size_t _length) {
+        size_t _keep = _echo_unit_left < _echo_used ? _echo_unit_left : _echo_used;
+        if (_length > _echo_size - _keep){
+          return false;
+        }
+        size_t _evicted = 0;
+        while (_echo_size - _echo_used + _evicted < _length){
+          size_t _index = (_echo_tail + _keep + _evicted) % _echo_size;
+          size_t _next = _unit_length(_index);
+          // The header of a text span was never going to be sent
+          _echo_dropped += _echo_buffer[_index] == ECHO_TEXT_SPAN ? _next - 2 : _next;
+          _evicted += _next;
+        }
+        // The rest of the started unit moves up to the new tail
+        for (size_t i = _keep; i > 0; i--){
+          _echo_buffer[(_echo_tail + _evicted + i - 1) % _echo_size] = _echo_buffer[(_echo_tail + i - 1) % _echo_size];
+        }
+        _echo_tail = (_echo_tail + _evicted) % _echo_size;
+        _echo_used -= _evicted;
+        _echo_text_open = false;
+        return true;
+      }
+
+      // Move up to _limit bytes from the ring to the Stream, one unit at a time when the ring holds records
+      void _drain(size_t _limit) {
+        while (_limit > 0 && _echo_used > 0){
+          if (_echo_records && _echo_unit_left == 0){
+            _echo_unit_left = _unit_length(_echo_tail);
+            if (_echo_buffer[_echo_tail] == ECHO_TEXT_SPAN){
+              // The Stream gets the text of a span without its header, no byte can be added to it anymore
+              _echo_text_open = false;
+              _echo_tail = (_echo_tail + 2) % _echo_size;
+              _echo_used -= 2;
+              _echo_unit_left -= 2;
+              continue;
+            }
+          }
+          size_t _count = _echo_size - _echo_tail;
+          if (_count > _echo_used) { _count = _echo_used; }
+          if (_count > _limit) { _count = _limit; }
+          if (_echo_records && _count > _echo_unit_left) { _count = _echo_unit_left; }
+          _echo_stream->write(_echo_buffer + _echo_tail, _count);
+          _echo_tail = (_echo_tail + _count) % _echo_size;
+          _echo_used -= _count;
+          _limit -= _count;
+          if (_echo_records){
+            _echo_unit_left -= _count;
+          }
+        }
+      }
+
+      // Copy bytes that fit into the ring
+      void _copy(const uint8_t *_data, size_t _length) {
+        while (_length > 0){
+          size_t _count = _echo_size - _echo_head;
+          if (_count > _length) { _count = _length; }
+          memcpy(_echo_buffer + _echo_head, _data, _count);
+          _echo_head = (_echo_head + _count) % _echo_size;
+          _echo_used += _count;
+          _data += _count;
+          _length -= _count;
+        }
+      }
+
+      // Copy in pieces of at most the ring size, each one waits for the Stream to make room
+      void _copy_waiting(const uint8_t *_data, size_t _length) {
+        while (_length > 0){
+          size_t _piece = _length < _echo_size ? _length : _echo_size;
+          while (_piece > _echo_size - _echo_used){
+            _drain(_stream_space());
+            yield();
+          }
+          _copy(_data, _piece);
+          _data += _piece;
+          _length -= _piece;
+        }
+      }
+
+      // Make room for _length bytes of units with the overflow policy, false when the policy keeps only what fits
+      bool _unit_room(size_t _length) {
+        if (_length > _echo_size){
+          return false;
+        }
+        if (_echo_policy == ECHO_BLOCK && _echo_stream != NULL){
+          while (_length > _echo_size - _echo_used){
+            _drain(_stream_space());
+            yield();
+          }
+          return true;
+        }
+        return _echo_policy == ECHO_OVERWRITE && _evict_units(_length);
+      }
+
+      // Copy text between binary records : spans of at most 255 bytes behind an ECHO_TEXT_SPAN header,
+      // so eviction only ever reads headers it wrote
+      size_t _write_text(const uint8_t *_data, size_t _length) {
+        size_t _written = 0;
+        while (_length > 0){
+          size_t _span = _echo_text_open ? _echo_buffer[(_echo_text_header + 1) % _echo_size] : 255;
+          size_t _header = _span < 255 ? 0 : 2;
+          size_t _piece = _header == 0 ? 255 - _span : 255;
+          if (_piece > _length) { _piece = _length; }
+          if (_piece + _header > _echo_size) { _piece = _echo_size > _header ? _echo_size - _header : 0; }
+          if (_piece == 0){
+            // A ring too small for a header and a byte
+            _echo_dropped += _length;
+            break;
+          }
+          size_t _free = _echo_size - _echo_used;
+          if (_piece + _header > _free){
+            if (_unit_room(_piece + _header)){
+              // Draining or evicting may have closed the open span, look again
+              continue;
+            }
+            _piece = _free > _header ? _free - _header : 0;
+            _echo_dropped += _length - _piece;
+            _length = _piece;
+            if (_piece == 0){
+              break;
+            }
+          }
+          if (_header > 0){
+            uint8_t _span_header[2] = { ECHO_TEXT_SPAN, 0 };
+            _echo_text_header = _echo_head;
+            _echo_text_open = true;
+            _copy(_span_header, 2);
+          }
+          _copy(_data, _piece);
+          _echo_buffer[(_echo_text_header + 1) % _echo_size] += _piece;
+          _data += _piece;
+          _length -= _piece;
+          _written += _piece;
+        }
+        return _written;
+      }
+
+      // Copy bytes into the ring, applying the overflow policy
+      size_t write(const uint8_t *_data, size_t _length) {
+        if (_echo_records){
+          return _write_text(_data, _length);
+        }
+        size_t _free = _echo_size - _echo_used;
+        if (_length > _free && _echo_policy == ECHO_BLOCK && _echo_stream != NULL){
+          _copy_waiting(_data, _length);
+          return _length;
+        }
+        if (_length > _free){
+          switch (_echo_policy){
+            case ECHO_BLOCK :                 // -> no Stream to wait for yet, keep what fits
+            case ECHO_DROP :
+              _echo_dropped += _length - _free;
+              _length = _free;
+            break;
+            case ECHO_OVERWRITE :
+              if (_length > _echo_size){
+                _echo_dropped += _length - _echo_size;
+                _data += _length - _echo_size;
+                _length = _echo_size;
+              }
+              _echo_dropped += _length - _free;
+              _echo_tail = (_echo_tail + _length - _free) % _echo_size;
+              _echo_used -= _length - _free;
+            break;
+          }
+        }
+        _copy(_data, _length);
+        return _length;
+      }
+
+      size_t write(uint8_t _c) {
+        return write(&_c, 1);
+      }
+
+      // Copy a binary record into the ring, a record that does not fit is dropped whole
+      void record(const uint8_t *_data, size_t _length) {
+        _echo_text_open = false;
+        if (_length > _echo_size && _echo_policy == ECHO_BLOCK && _echo_stream != NULL){
+          // Larger than the ring : the Stream takes its head while the rest is copied
+          _copy_waiting(_data, _length);
+          return;
+        }
+        if (_length > _echo_size - _echo_used && !_unit_room(_length)){
+          _echo_dropped += _length;
+          return;
+        }
+        _copy(_data, _length);
+      }
+
+      // Switch the ring between text and units, the bytes the Stream has not taken yet are dropped
+      void _frame(bool _records) {
+        if (_records != _echo_records){
+          _echo_dropped += _echo_used;
+          _echo_head = 0;
+          _echo_tail = 0;
+          _echo_used = 0;
+          _echo_unit_left = 0;
+          _echo_text_open = false;
+          _echo_records = _records;
+        }
+      }
+    };
+
+    _echoes *_first_echo = NULL, *_last_echo = NULL;
+
     // Class for Echo : class that creates an Echo object
     class Echo {
       private :
       Stream* _current_stream;
+      _echoes* _this_echo;
+      bool _binary;
+      Print* _output() {
+        return this->_this_echo != NULL ? (Print*)this->_this_echo : (Print*)this->_current_stream;
+      }
+      // Echo Class record function : one binary record for a phrase id and its typed arguments
+      template <typename... _print_args>
+      void _record(uint32_t _id, const _print_args&... _arguments) {
+        tweaklystring::_format_arg _args[] = { tweaklystring::_make_format_arg(_arguments)..., tweaklystring::_format_arg() };
+        _echo_record _new_record(_id);
+        for (uint8_t i = 0; i < sizeof...(_arguments); i++){
+          _new_record.putArg(_args[i]);
+        }
+        if (this->_this_echo != NULL){
+          this->_this_echo->record(_new_record.bytes(), _new_record.length());
+        } else if (this->_current_stream != NULL){
+          this->_current_stream->write(_new_record.bytes(), _new_record.length());
+        }
+      }
       public :
       Echo() {
-
+        _current_stream = NULL;
+        _this_echo = NULL;
+        _binary = false;
+      }
+      // Echo Class print function : format typed arguments straight into the Stream (or its buffer), without heap
+      template <typename... _print_args>
+      void print(const char* phrase, const _print_args&... _arguments) {
+        if (this->_binary){
+          this->_record(_phrase_id_now(phrase), _arguments...);
+        } else {
+          tweaklystring::streamAssembler(this->_output(), phrase, _arguments...);
+        }
       }
-      void print(const char* phrase, ...);
+      // Echo Class log function : used by ECHO_LOG, same as print but the phrase id is computed by the compiler
+      template <typename... _print_args>
+      void log(uint32_t _id, const char* phrase, const _print_args&... _arguments) {
+        if (this->_binary){
+          this->_record(_id, _arguments...);
+        } else {
+          tweaklystring::streamAssembler(this->_output(), phrase, _arguments...);
+        }
+      }
+      void binary(bool);
+      void dumpTrace();
+      void dumpLoop();
+      void dumpProfile();
       void write(const char* phrase, ...);
       void attach(Stream*);
+      void buffer(size_t _size, uint8_t _policy);
+      void flush();
+      size_t pending();
+      unsigned long dropped();
     };
 
-    // Echo Class print function : print on a Stream object
-
-    void Echo::print(const char* phrase, ...) {
-      char complete_phrase[200];
-      va_list arguments;
-      va_start(arguments, phrase);
-      vsprintf(complete_phrase, phrase, arguments);
-      va_end(arguments);
-      this->_current_stream->print(complete_phrase);
-    }
-
     // Echo Class attach function : attach a Stream object
 
     void Echo::attach(Stream* _new_stream) {
        this->_current_stream = _new_stream;
+       if (this->_this_echo != NULL){
+         this->_this_echo->_echo_stream = _new_stream;
+       }
     } 
 
+    // Echo Class binary function : write compact records (phrase id, timestamp, raw arguments) instead of text,
+    // extras/echo_decode.py turns a capture back into text; the buffer is flushed first, what cannot be sent is dropped
+
+    void Echo::binary(bool _enable) {
+       this->_binary = _enable;
+       if (this->_this_echo != NULL){
+         this->flush();
+         this->_this_echo->_frame(_enable);
+       }
+    }
+
+    // Echo Class dumpTrace function : print the events kept by the trace module, oldest first
+
+    void Echo::dumpTrace() {
+       tweaklytrace::traceDump(this->_output());
+    }
+
+    // Echo Class dumpLoop function : print the histograms of the loop monitor
+
+    void Echo::dumpLoop() {
+       tweaklymonitor::loopDump(this->_output());
+    }
+
+    // Echo Class dumpProfile function : print the runs and times of every module of TweaklyRun
+
+    void Echo::dumpProfile() {
+       tweaklyrun::profileDump(this->_output());
+    }
+
+    // Echo Class buffer function : print into a ring of _size bytes, sent to the Stream by TweaklyRun() as fast as it accepts them,
+    // a size of 0 is refused and the Echo keeps writing as before
+
+    void Echo::buffer(size_t _size, uint8_t _policy = ECHO_DROP) {
+       if (_size == 0){
+         return;
+       }
+       if (this->_this_echo == NULL){
+         _echoes *_new_echo = new _echoes;
+         if (_first_echo == NULL){
+           _first_echo = _new_echo;
+         }else{
+           _last_echo->_next_echo = _new_echo;
+         }
+         _last_echo = _new_echo;
+         this->_this_echo = _new_echo;
+       } else {
+         this->flush();
+         delete[] this->_this_echo->_echo_buffer;
+       }
+       this->_this_echo->_echo_stream = this->_current_stream;
+       this->_this_echo->_echo_buffer = new uint8_t[_size];
+       this->_this_echo->_echo_size = _size;
+       this->_this_echo->_echo_head = 0;
+       this->_this_echo->_echo_tail = 0;
+       this->_this_echo->_echo_used = 0;
+       this->_this_echo->_echo_unit_left = 0;
+       this->_this_echo->_echo_text_open = false;
+       this->_this_echo->_echo_records = this->_binary;
+       this->_this_echo->_echo_policy = _policy;
+       if (!_echo_exists){
+         _echo_exists = true;
+       }
+    }
+
+    // Echo Class flush function : send the whole buffer now, waiting for the Stream
+
+    void Echo::flush() {
+       if (this->_this_echo != NULL && this->_this_echo->_echo_stream != NULL){
+         while (this->_this_echo->_echo_used > 0){
+           this->_this_echo->_drain(this->_this_echo->_stream_space());
+           yield();
+         }
+       }
+    }
+
+    // Echo Class pending function : bytes waiting in the buffer
+
+    size_t Echo::pending() {
+       return this->_this_echo != NULL ? this->_this_echo->_echo_used : 0;
+    }
+
+    // Echo Class dropped function : bytes lost by the overflow policy
+
+    unsigned long Echo::dropped() {
+       return this->_this_echo != NULL ? this->_this_echo->_echo_dropped : 0;
+    }
+
+    // Loop for all Echo buffers : drain each one as fast as its Stream allows
+    void Loop() {
+      if (_echo_exists){
+        for (_echoes *_this_echo = _first_echo; _this_echo != NULL; _this_echo = _this_echo->_next_echo){
+          if (_this_echo->_echo_used > 0 && _this_echo->_echo_stream != NULL){
+            _this_echo->_drain(_this_echo->_stream_space());
+          }
+        }
+      }
+    }
+
+    // Idle while there are no buffered Echoes
+    bool _echoes_idle() {
+      return !_echo_exists;
+    }
+
+    tweaklyrun::Module _echoes_module("stream", Loop, MODULE_ORDER_APPS, NULL, _echoes_idle);
+
 }
 
+// Log through an Echo with the phrase id computed at compile time, prints text when the Echo is not in binary mode
+#define ECHO_LOG(_echo, _phrase, ...) (_echo).log(stream::_echo_phrase<stream::_phrase_id(_phrase)>::id, _phrase, ##__VA_ARGS__)
+
 #endif
\ No newline at end of file
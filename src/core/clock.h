@@ -34,51 +34,169 @@
 
 namespace tweaklyclock {
 
+   // Definitions for clocks
+   #define CLOCK_SECONDS_PER_DAY 86400UL
+   #define CLOCK_MICROS_PER_SECOND 1000000UL
+   #define CLOCK_MAX_SLEEP_MILLIS 60000UL     // -> clocks are re-anchored at least once a minute (micros() wraps after ~71 minutes)
+
+   // Definitions for week days
+   #define CLOCK_SUNDAY 0
+   #define CLOCK_MONDAY 1
+   #define CLOCK_TUESDAY 2
+   #define CLOCK_WEDNESDAY 3
+   #define CLOCK_THURSDAY 4
+   #define CLOCK_FRIDAY 5
+   #define CLOCK_SATURDAY 6
+
+   // Definitions for alarms
+   #define CLOCK_ALARM_ONCE 0
+   #define CLOCK_ALARM_DAILY 1
+
    // Counters
    unsigned long _clock_counter = 0;
   
    // Enablers
    volatile bool _clocks_exists { false };
+   volatile bool _clock_reschedule { true };
+
+   // Scheduler : Loop() does nothing until this deadline
+   unsigned long _clock_wake_millis = 0;
 
    // Type definition
    typedef void (*_alarm_callback)();
+   typedef void (*_alarm_context_callback)(void *);
+
+   // Struct required for alarms, sorted by next trigger time
+   struct _alarms{
+     unsigned long    _alarm_next;
+     uint8_t          _alarm_mode;
+     tweaklyevents::_callable _alarm_callback_function;
+     _alarms *        _next_alarm = NULL;
+   };
 
    // Struct required for clocks
    struct _clocks{
      unsigned long  _clock_position;
-     unsigned long  _clock_current_millis;
-     unsigned long  _clock_delay;
-     unsigned long  _clock_previous_time;
-     uint8_t        _clock_seconds;
-     uint8_t        _clock_minutes;
-     uint8_t        _clock_hours;
-     uint8_t        _alarm_seconds;
-     uint8_t        _alarm_minutes;
-     uint8_t        _alarm_hours;
      unsigned long  _clock_epoch;
-     _alarm_callback  _alarm_callback_function;
+     unsigned long  _clock_anchor_micros;
+     unsigned long  _clock_second_micros;
+     long           _clock_trim_ppm;
+     _alarms *      _first_alarm = NULL;
     _clocks *       _next_clock = NULL;
    };
 
    _clocks *_first_clock = NULL, *_last_clock =  NULL;
+   tweaklystorage::_records<_clocks, TWEAKLY_STATIC_CLOCKS> _clocks_storage;
+
+   // Struct for calendar date
+   struct clockDate {
+     uint16_t year;
+     uint8_t  month;
+     uint8_t  day;
+     uint8_t  weekDay;
+   };
+
+   // Days since 1970-01-01 of a civil date
+   unsigned long _days_from_civil(uint16_t _year, uint8_t _month, uint8_t _day) {
+     long _y = (long)_year - (_month <= 2 ? 1 : 0);
+     long _era = _y / 400;
+     long _yoe = _y - _era * 400;
+     long _doy = (153L * (_month > 2 ? _month - 3 : _month + 9) + 2) / 5 + _day - 1;
+     long _doe = _yoe * 365 + _yoe / 4 - _yoe / 100 + _doy;
+     return (unsigned long)(_era * 146097L + _doe - 719468L);
+   }
+
+   // Civil date of a number of days since 1970-01-01
+   clockDate _civil_from_days(unsigned long _days) {
+     clockDate _date;
+     long _z = (long)_days + 719468L;
+     long _era = _z / 146097L;
+     long _doe = _z - _era * 146097L;
+     long _yoe = (_doe - _doe / 1460 + _doe / 36524 - _doe / 146096) / 365;
+     long _doy = _doe - (365 * _yoe + _yoe / 4 - _yoe / 100);
+     long _mp = (5 * _doy + 2) / 153;
+     _date.day = _doy - (153 * _mp + 2) / 5 + 1;
+     _date.month = _mp < 10 ? _mp + 3 : _mp - 9;
+     _date.year = _yoe + _era * 400 + (_date.month <= 2 ? 1 : 0);
+     _date.weekDay = (_days + CLOCK_THURSDAY) % 7;
+     return _date;
+   }
+
+   // Find the record of a clock
+   _clocks *_find_clock(unsigned long _position) {
+     if (_clocks_exists){
+       for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
+         if (_this_clock->_clock_position == _position){
+           return _this_clock;
+         }
+       }
+     }
+     return NULL;
+   }
+
+   // Insert an alarm in the sorted list of a clock
+   void _insert_alarm(_clocks *_this_clock, _alarms *_new_alarm) {
+     _alarms **_link = &_this_clock->_first_alarm;
+     while (*_link != NULL && (*_link)->_alarm_next <= _new_alarm->_alarm_next){
+       _link = &(*_link)->_next_alarm;
+     }
+     _new_alarm->_next_alarm = *_link;
+     *_link = _new_alarm;
+   }
+
+   // Next trigger of a daily alarm after the current time of the clock
+   unsigned long _next_daily_alarm(_clocks *_this_clock, unsigned long _time_of_day) {
+     unsigned long _next = _this_clock->_clock_epoch - _this_clock->_clock_epoch % CLOCK_SECONDS_PER_DAY + _time_of_day;
+     if (_next <= _this_clock->_clock_epoch){
+       _next += CLOCK_SECONDS_PER_DAY;
+     }
+     return _next;
+   }
+
+   // Advance the epoch of a clock by the whole seconds elapsed from its anchor
+   void _clock_update(_clocks *_this_clock, unsigned long _current_micros) {
+     while ((unsigned long)(_current_micros - _this_clock->_clock_anchor_micros) >= _this_clock->_clock_second_micros){
+       _this_clock->_clock_anchor_micros += _this_clock->_clock_second_micros;
+       _this_clock->_clock_epoch++;
+     }
+   }
+
+   // Move a clock to a new epoch and reschedule its alarms
+   void _clock_set_epoch(_clocks *_this_clock, unsigned long _new_epoch) {
+     _clock_update(_this_clock, micros());
+     _this_clock->_clock_epoch = _new_epoch;
+     _alarms *_this_alarm = _this_clock->_first_alarm;
+     _this_clock->_first_alarm = NULL;
+     while (_this_alarm != NULL){
+       _alarms *_next_alarm = _this_alarm->_next_alarm;
+       if (_this_alarm->_alarm_mode == CLOCK_ALARM_DAILY){
+         _this_alarm->_alarm_next = _next_daily_alarm(_this_clock, _this_alarm->_alarm_next % CLOCK_SECONDS_PER_DAY);
+       }
+       _insert_alarm(_this_clock, _this_alarm);
+       _this_alarm = _next_alarm;
+     }
+     _clock_reschedule = true;
+   }
    
   // Clock Class
   class Clock {
     private :
     unsigned long _this_position = _clock_counter++;
+    void _add_alarm(uint8_t _alarm_mode, unsigned long _alarm_time, const tweaklyevents::_callable &_new_alarm_callback);
     public :
+    template <typename _static_check = void>
     Clock() {
-      _clocks *_new_clock = new _clocks;
+      _TWEAKLY_REQUIRES(TWEAKLY_STATIC_CLOCKS, "a Clock needs TWEAKLY_STATIC_CLOCKS in static mode");
+      _clocks *_new_clock = _clocks_storage.take();
       if (_first_clock == NULL){
       _first_clock = _new_clock;
       }else{
        _last_clock->_next_clock = _new_clock;
       }
-      _new_clock->_clock_previous_time = 0;
-      _new_clock->_clock_seconds = 0;
-      _new_clock->_clock_minutes = 0;
-      _new_clock->_clock_hours = 0;
-      _new_clock->_clock_delay = 1000;
+      _new_clock->_clock_epoch = 0;
+      _new_clock->_clock_anchor_micros = micros();
+      _new_clock->_clock_second_micros = CLOCK_MICROS_PER_SECOND;
+      _new_clock->_clock_trim_ppm = 0;
       _new_clock->_clock_position = _this_position;
       _last_clock = _new_clock;
       if (!_clocks_exists){
@@ -88,153 +206,285 @@ namespace tweaklyclock {
     void setSeconds(uint8_t _new_seconds);
     void setMinutes(uint8_t _new_minutes);
     void setHours(uint8_t _new_hours);
+    void setDate(uint8_t _new_day, uint8_t _new_month, uint16_t _new_year);
+    void setEpoch(unsigned long _new_epoch);
+    void setTrim(long _new_trim_ppm);
     uint8_t getSeconds();
     uint8_t getMinutes();
     uint8_t getHours();
+    uint8_t getDay();
+    uint8_t getMonth();
+    uint16_t getYear();
+    uint8_t getWeekDay();
+    clockDate getDate();
+    unsigned long getEpoch();
     void setAlarm(uint8_t _alarm_hours, uint8_t _alarm_minutes, uint8_t _alarm_seconds, _alarm_callback _alarm_callback);
+    void setAlarm(unsigned long _alarm_epoch, _alarm_callback _alarm_callback);
+    void setAlarm(uint8_t _alarm_hours, uint8_t _alarm_minutes, uint8_t _alarm_seconds, _alarm_context_callback _alarm_callback, void *_context);
+    void setAlarm(unsigned long _alarm_epoch, _alarm_context_callback _alarm_callback, void *_context);
+    void addAlarm(uint8_t _alarm_hours, uint8_t _alarm_minutes, uint8_t _alarm_seconds, _alarm_callback _alarm_callback);
+    void addAlarm(unsigned long _alarm_epoch, _alarm_callback _alarm_callback);
+    void addAlarm(uint8_t _alarm_hours, uint8_t _alarm_minutes, uint8_t _alarm_seconds, _alarm_context_callback _alarm_callback, void *_context);
+    void addAlarm(unsigned long _alarm_epoch, _alarm_context_callback _alarm_callback, void *_context);
+    void clearAlarms();
     void autoSync();
   };
   
-  //Sync clock with computer time
+  //Sync clock with computer time and date
   void Clock::autoSync() {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          int hours, minutes, seconds = 0;
-          if (sscanf(__TIME__, "%d:%d:%d", &hours, &minutes, &seconds) != 3) {
-            return;
-          }
-          _this_clock->_clock_hours = hours;
-          _this_clock->_clock_minutes = minutes;
-          _this_clock->_clock_seconds = seconds;
-        }
+    _clocks *_this_clock = _find_clock(this->_this_position);
+    if (_this_clock != NULL){
+      int hours, minutes, seconds = 0;
+      if (sscanf(__TIME__, "%d:%d:%d", &hours, &minutes, &seconds) != 3) {
+        return;
+      }
+      char month_name[4];
+      int day, year = 0;
+      if (sscanf(__DATE__, "%3s %d %d", month_name, &day, &year) != 3) {
+        return;
       }
+      const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+      uint8_t month = (strstr(months, month_name) - months) / 3 + 1;
+      _clock_set_epoch(_this_clock, _days_from_civil(year, month, day) * CLOCK_SECONDS_PER_DAY + hours * 3600UL + minutes * 60UL + seconds);
     }
   }
 
-  // Get seconds
-  uint8_t Clock::getSeconds() {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          return _this_clock->_clock_seconds;
-        }
-      }
+  // Get epoch (seconds since 1970-01-01 00:00:00)
+  unsigned long Clock::getEpoch() {
+    _clocks *_this_clock = _find_clock(this->_this_position);
+    if (_this_clock != NULL){
+      _clock_update(_this_clock, micros());
+      return _this_clock->_clock_epoch;
     }
     return 0;
   }
+
+  // Get seconds
+  uint8_t Clock::getSeconds() {
+    return this->getEpoch() % 60;
+  }
   
   //Get minutes
   uint8_t Clock::getMinutes() {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          return _this_clock->_clock_minutes;
-        }
-      }
-    }
-    return 0;
+    return this->getEpoch() / 60 % 60;
   }
 
   //Get hours
   uint8_t Clock::getHours() {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          return _this_clock->_clock_hours;
-        }
-      }
+    return this->getEpoch() % CLOCK_SECONDS_PER_DAY / 3600;
+  }
+
+  //Get date
+  clockDate Clock::getDate() {
+    return _civil_from_days(this->getEpoch() / CLOCK_SECONDS_PER_DAY);
+  }
+
+  //Get day of the month
+  uint8_t Clock::getDay() {
+    return this->getDate().day;
+  }
+
+  //Get month
+  uint8_t Clock::getMonth() {
+    return this->getDate().month;
+  }
+
+  //Get year
+  uint16_t Clock::getYear() {
+    return this->getDate().year;
+  }
+
+  //Get day of the week (CLOCK_SUNDAY ... CLOCK_SATURDAY)
+  uint8_t Clock::getWeekDay() {
+    return this->getDate().weekDay;
+  }
+
+  // Set epoch
+  void Clock::setEpoch(unsigned long _new_epoch) {
+    _clocks *_this_clock = _find_clock(this->_this_position);
+    if (_this_clock != NULL){
+      _clock_set_epoch(_this_clock, _new_epoch);
     }
-    return 0;
   }
 
    // Set seconds
   void Clock::setSeconds(uint8_t _new_seconds) {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          _this_clock->_clock_seconds = _new_seconds;
-        }
-      }
-    }
+    unsigned long _epoch = this->getEpoch();
+    this->setEpoch(_epoch - _epoch % 60 + _new_seconds);
   }
   
   //Set minutes
   void Clock::setMinutes(uint8_t _new_minutes) {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          _this_clock->_clock_minutes = _new_minutes;
-        }
-      }
-    }
+    unsigned long _epoch = this->getEpoch();
+    this->setEpoch(_epoch - (_epoch / 60 % 60) * 60 + _new_minutes * 60UL);
   }
 
   //Set hours
   void Clock::setHours(uint8_t _new_hours) {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          _this_clock->_clock_hours = _new_hours;
-        }
-      }
+    unsigned long _epoch = this->getEpoch();
+    this->setEpoch(_epoch - (_epoch % CLOCK_SECONDS_PER_DAY / 3600) * 3600 + _new_hours * 3600UL);
+  }
+
+  //Set date, the time of the day is kept
+  void Clock::setDate(uint8_t _new_day, uint8_t _new_month, uint16_t _new_year) {
+    unsigned long _epoch = this->getEpoch();
+    this->setEpoch(_days_from_civil(_new_year, _new_month, _new_day) * CLOCK_SECONDS_PER_DAY + _epoch % CLOCK_SECONDS_PER_DAY);
+  }
+
+  //Set trim: crystal error in ppm, positive if the board runs fast
+  void Clock::setTrim(long _new_trim_ppm) {
+    _clocks *_this_clock = _find_clock(this->_this_position);
+    if (_this_clock != NULL){
+      _clock_update(_this_clock, micros());
+      _this_clock->_clock_trim_ppm = _new_trim_ppm;
+      _this_clock->_clock_second_micros = CLOCK_MICROS_PER_SECOND + _new_trim_ppm;
+      _clock_reschedule = true;
     }
   }
 
-  //Set alarm
+  //Set daily alarm, it replaces the alarms of the clock
   void Clock::setAlarm(uint8_t _new_alarm_hours, uint8_t _new_alarm_minutes, uint8_t _new_alarm_seconds, _alarm_callback _new_alarm_callback) {
-    if (_clocks_exists){
-      for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        if (_this_clock->_clock_position == this->_this_position){
-          _this_clock->_alarm_hours = _new_alarm_hours;
-          _this_clock->_alarm_minutes = _new_alarm_minutes;
-          _this_clock->_alarm_seconds = _new_alarm_seconds;
-          _this_clock->_alarm_callback_function = _new_alarm_callback;
-        }
+    this->clearAlarms();
+    this->addAlarm(_new_alarm_hours, _new_alarm_minutes, _new_alarm_seconds, _new_alarm_callback);
+  }
+
+  //Set daily alarm, the callback receives _context, it replaces the alarms of the clock
+  void Clock::setAlarm(uint8_t _new_alarm_hours, uint8_t _new_alarm_minutes, uint8_t _new_alarm_seconds, _alarm_context_callback _new_alarm_callback, void *_context) {
+    this->clearAlarms();
+    this->addAlarm(_new_alarm_hours, _new_alarm_minutes, _new_alarm_seconds, _new_alarm_callback, _context);
+  }
+
+  //Set one shot alarm at an epoch, it replaces the alarms of the clock
+  void Clock::setAlarm(unsigned long _new_alarm_epoch, _alarm_callback _new_alarm_callback) {
+    this->clearAlarms();
+    this->addAlarm(_new_alarm_epoch, _new_alarm_callback);
+  }
+
+  //Set one shot alarm at an epoch, the callback receives _context, it replaces the alarms of the clock
+  void Clock::setAlarm(unsigned long _new_alarm_epoch, _alarm_context_callback _new_alarm_callback, void *_context) {
+    this->clearAlarms();
+    this->addAlarm(_new_alarm_epoch, _new_alarm_callback, _context);
+  }
+
+  //Add a daily alarm to the ones of the clock
+  void Clock::addAlarm(uint8_t _new_alarm_hours, uint8_t _new_alarm_minutes, uint8_t _new_alarm_seconds, _alarm_callback _new_alarm_callback) {
+    this->_add_alarm(CLOCK_ALARM_DAILY, _new_alarm_hours * 3600UL + _new_alarm_minutes * 60UL + _new_alarm_seconds, tweaklyevents::_make_callable(_new_alarm_callback));
+  }
+
+  //Add a daily alarm, the callback receives _context
+  void Clock::addAlarm(uint8_t _new_alarm_hours, uint8_t _new_alarm_minutes, uint8_t _new_alarm_seconds, _alarm_context_callback _new_alarm_callback, void *_context) {
+    this->_add_alarm(CLOCK_ALARM_DAILY, _new_alarm_hours * 3600UL + _new_alarm_minutes * 60UL + _new_alarm_seconds, tweaklyevents::_make_callable(_new_alarm_callback, _context));
+  }
+
+  //Add a one shot alarm at an epoch
+  void Clock::addAlarm(unsigned long _new_alarm_epoch, _alarm_callback _new_alarm_callback) {
+    this->_add_alarm(CLOCK_ALARM_ONCE, _new_alarm_epoch, tweaklyevents::_make_callable(_new_alarm_callback));
+  }
+
+  //Add a one shot alarm at an epoch, the callback receives _context
+  void Clock::addAlarm(unsigned long _new_alarm_epoch, _alarm_context_callback _new_alarm_callback, void *_context) {
+    this->_add_alarm(CLOCK_ALARM_ONCE, _new_alarm_epoch, tweaklyevents::_make_callable(_new_alarm_callback, _context));
+  }
+
+  //Add an alarm : CLOCK_ALARM_DAILY at _alarm_time seconds of the day, CLOCK_ALARM_ONCE at the _alarm_time epoch
+  void Clock::_add_alarm(uint8_t _alarm_mode, unsigned long _alarm_time, const tweaklyevents::_callable &_new_alarm_callback) {
+    _clocks *_this_clock = _find_clock(this->_this_position);
+    if (_this_clock != NULL){
+      _alarms *_new_alarm = new _alarms;
+      _new_alarm->_alarm_mode = _alarm_mode;
+      if (_alarm_mode == CLOCK_ALARM_DAILY){
+        _clock_update(_this_clock, micros());
+        _new_alarm->_alarm_next = _next_daily_alarm(_this_clock, _alarm_time);
+      } else {
+        _new_alarm->_alarm_next = _alarm_time;
       }
+      _new_alarm->_alarm_callback_function = _new_alarm_callback;
+      _insert_alarm(_this_clock, _new_alarm);
+      _clock_reschedule = true;
     }
   }
 
+  //Remove all alarms
+  void Clock::clearAlarms() {
+    _clocks *_this_clock = _find_clock(this->_this_position);
+    if (_this_clock != NULL){
+      while (_this_clock->_first_alarm != NULL){
+        _alarms *_this_alarm = _this_clock->_first_alarm;
+        _this_clock->_first_alarm = _this_alarm->_next_alarm;
+        delete _this_alarm;
+      }
+    }
+  }
+
+  // Milliseconds until the first alarm of a clock, capped to CLOCK_MAX_SLEEP_MILLIS
+  unsigned long _clock_sleep_millis(_clocks *_this_clock, unsigned long _current_micros) {
+    if (_this_clock->_first_alarm == NULL || _this_clock->_first_alarm->_alarm_next - _this_clock->_clock_epoch > CLOCK_MAX_SLEEP_MILLIS / 1000){
+      return CLOCK_MAX_SLEEP_MILLIS;
+    }
+    unsigned long _remaining_micros = (_this_clock->_first_alarm->_alarm_next - _this_clock->_clock_epoch) * _this_clock->_clock_second_micros
+                                      - (unsigned long)(_current_micros - _this_clock->_clock_anchor_micros);
+    return _remaining_micros / 1000;
+  }
+
   // Setup all Clocks
   void Setup() {
      if (_clocks_exists){
-       unsigned long _current_millis = millis();
+       unsigned long _current_micros = micros();
        for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-          _this_clock->_clock_previous_time = _current_millis;
+          _clock_update(_this_clock, _current_micros);
        }
+       _clock_reschedule = true;
      }
   }
    
-   // Loop for all Clocks
+   // Loop for all Clocks: clocks are evaluated on demand, Loop() only wakes up for the next alarm
    void Loop() {
      if (_clocks_exists){
       unsigned long _current_millis = millis();
+      if (!_clock_reschedule && (long)(_current_millis - _clock_wake_millis) < 0){
+        return;
+      }
+      _clock_reschedule = false;
+      unsigned long _sleep_millis = CLOCK_MAX_SLEEP_MILLIS;
       for (_clocks *_this_clock = _first_clock; _this_clock != NULL; _this_clock = _this_clock->_next_clock){
-        _this_clock->_clock_current_millis = _current_millis;
-         if ((unsigned long)(_this_clock->_clock_current_millis - _this_clock->_clock_previous_time) >= _this_clock->_clock_delay){
-         _this_clock->_clock_previous_time = _this_clock->_clock_current_millis;
-         _this_clock->_clock_seconds++;
-         if(_this_clock->_clock_seconds == 60) {
-           _this_clock->_clock_seconds = 0;
-           _this_clock->_clock_minutes++;
-         }
-         if(_this_clock->_clock_minutes == 60) {
-           _this_clock->_clock_minutes = 0;
-           _this_clock->_clock_hours++;
-         }
-         if(_this_clock->_clock_hours > 23) {
-           _this_clock->_clock_hours = 0;
-         }
-         if(_this_clock->_clock_hours == _this_clock->_alarm_hours && 
-            _this_clock->_clock_minutes == _this_clock->_alarm_minutes &&
-            _this_clock->_clock_seconds == _this_clock->_alarm_seconds) {
-              _this_clock->_alarm_callback_function();
-            }
-         }
+        unsigned long _current_micros = micros();
+        _clock_update(_this_clock, _current_micros);
+        while (_this_clock->_first_alarm != NULL && _this_clock->_first_alarm->_alarm_next <= _this_clock->_clock_epoch){
+          _alarms *_this_alarm = _this_clock->_first_alarm;
+          _this_clock->_first_alarm = _this_alarm->_next_alarm;
+          if (_this_alarm->_alarm_mode == CLOCK_ALARM_DAILY){
+            _this_alarm->_alarm_next += CLOCK_SECONDS_PER_DAY;
+            _insert_alarm(_this_clock, _this_alarm);
+            tweaklyevents::_post_event(EVENT_FROM_CLOCK, _this_clock->_clock_position, _this_alarm->_alarm_callback_function, EVENT_CALL_VOID, _this_alarm->_alarm_next, EVENT_KEEP_ALL);
+          } else {
+            tweaklyevents::_callable _callback = _this_alarm->_alarm_callback_function;
+            unsigned long _alarm_epoch = _this_alarm->_alarm_next;
+            delete _this_alarm;
+            tweaklyevents::_post_event(EVENT_FROM_CLOCK, _this_clock->_clock_position, _callback, EVENT_CALL_VOID, _alarm_epoch, EVENT_KEEP_ALL);
+          }
+        }
+        unsigned long _clock_sleep = _clock_sleep_millis(_this_clock, _current_micros);
+        if (_clock_sleep < _sleep_millis){
+          _sleep_millis = _clock_sleep;
+        }
       }
+      _clock_wake_millis = _current_millis + _sleep_millis;
     }
    }
 
+   // Idle while there are no Clocks, asleep until the next alarm
+   bool _clocks_idle() {
+     return !_clocks_exists;
+   }
+
+   unsigned long _clocks_deadline() {
+     return _clock_reschedule ? millis() : _clock_wake_millis;
+   }
+
+   #if _TWEAKLY_USES(TWEAKLY_STATIC_CLOCKS)
+   tweaklyrun::Module _clocks_module("clock", Loop, MODULE_ORDER_CLOCK, Setup, _clocks_idle, _clocks_deadline);
+   #endif
+
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,243 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * EVENTS MODULE FOR TWEAKLY
+ *
+ * Pads, timers, clocks, sonars and encoders hand their callbacks to this module.
+ * By default a posted event is called at once, as before.
+ * With #define TWEAKLY_EVENT_QUEUE before #include "Tweakly.h" events wait in a
+ * fixed queue of TWEAKLY_EVENT_QUEUE_SIZE and TweaklyRun() calls them after every
+ * module has looked at its inputs, within the time budget set with eventBudget().
+ *
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+namespace tweaklyevents {
+
+    // Subsystems that post events
+    #define EVENT_FROM_PAD 0
+    #define EVENT_FROM_TIMER 1
+    #define EVENT_FROM_CLOCK 2
+    #define EVENT_FROM_SONAR 3
+    #define EVENT_FROM_ENCODER 4
+
+    // Signature of the callback of an event
+    #define EVENT_CALL_VOID 0                 // -> void callback()
+    #define EVENT_CALL_BOOL 1                 // -> void callback(bool payload)
+    #define EVENT_CALL_INT 2                  // -> void callback(int payload)
+    #define EVENT_CALL_ULONG 3                // -> void callback(unsigned long payload)
+
+    // What happens to an event posted while the same one is still queued
+    #define EVENT_KEEP_ALL 0                  // -> both are called
+    #define EVENT_REPLACE 1                   // -> the queued one takes the new payload
+    #define EVENT_ADD 2                       // -> the payloads are summed
+
+    #ifndef TWEAKLY_EVENT_QUEUE_SIZE
+      #define TWEAKLY_EVENT_QUEUE_SIZE 16
+    #endif
+    // The head and the count of the queue are bytes
+    static_assert(TWEAKLY_EVENT_QUEUE_SIZE > 0 && TWEAKLY_EVENT_QUEUE_SIZE <= 255, "TWEAKLY_EVENT_QUEUE_SIZE must be between 1 and 255");
+
+    typedef void (*_event_handler)();
+
+    // Callback of any module : a function and, when it was attached with one, the context pointer handed back to it.
+    // One handler can serve many pads, timers or sonars without globals and without heap.
+    struct _callable {
+      _event_handler  _function;
+      void *          _context;
+      bool            _contextual;
+    };
+
+    template <typename _function_type>
+    inline _callable _make_callable(_function_type *_function) {
+      _callable _new_callable = { (_event_handler)_function, NULL, false };
+      return _new_callable;
+    }
+
+    template <typename _function_type>
+    inline _callable _make_callable(_function_type *_function, void *_context) {
+      _callable _new_callable = { (_event_handler)_function, _context, true };
+      return _new_callable;
+    }
+
+    inline bool _same_callable(const _callable &_a, const _callable &_b) {
+      return _a._function == _b._function && _a._context == _b._context && _a._contextual == _b._contextual;
+    }
+
+    // Struct for an event
+    struct _event {
+      unsigned long   _event_micros;
+      long            _event_payload;
+      _callable       _event_callable;
+      uint16_t        _event_source;
+      uint8_t         _event_from;
+      uint8_t         _event_signature;
+    };
+
+    // Struct for the queue statistics
+    struct eventStats {
+      unsigned int depth;                     // -> events waiting now
+      unsigned int maxDepth;                  // -> most events ever waiting
+      unsigned long dispatched;               // -> events called from the queue
+      unsigned long coalesced;                // -> events merged into a queued one
+      unsigned long overflowed;               // -> events called at once because the queue was full
+      unsigned long maxLatencyMicros;         // -> longest wait between post and call
+    };
+
+    // Call a callable with the payload of its signature, and its context first when it has one
+    inline void _call_event(const _callable &_callback, uint8_t _signature, long _payload) {
+      _event_handler _handler = _callback._function;
+      if (_handler == NULL){
+        return;
+      }
+      if (!_callback._contextual){
+        switch (_signature){
+          case EVENT_CALL_VOID :
+            _handler();
+          break;
+          case EVENT_CALL_BOOL :
+            ((void (*)(bool))_handler)(_payload != 0);
+          break;
+          case EVENT_CALL_INT :
+            ((void (*)(int))_handler)((int)_payload);
+          break;
+          case EVENT_CALL_ULONG :
+            ((void (*)(unsigned long))_handler)((unsigned long)_payload);
+          break;
+        }
+      } else {
+        switch (_signature){
+          case EVENT_CALL_VOID :
+            ((void (*)(void *))_handler)(_callback._context);
+          break;
+          case EVENT_CALL_BOOL :
+            ((void (*)(void *, bool))_handler)(_callback._context, _payload != 0);
+          break;
+          case EVENT_CALL_INT :
+            ((void (*)(void *, int))_handler)(_callback._context, (int)_payload);
+          break;
+          case EVENT_CALL_ULONG :
+            ((void (*)(void *, unsigned long))_handler)(_callback._context, (unsigned long)_payload);
+          break;
+        }
+      }
+    }
+
+    #if defined(TWEAKLY_EVENT_QUEUE)
+
+    _event _events[TWEAKLY_EVENT_QUEUE_SIZE];
+    uint8_t _events_head = 0;
+    uint8_t _events_count = 0;
+    unsigned long _events_budget_micros = 0;
+    eventStats _events_stats = { 0, 0, 0, 0, 0, 0 };
+
+    // Post an event : it is called by TweaklyRun(), after the modules of this pass
+    void _post_event(uint8_t _from, uint16_t _source, const _callable &_callback, uint8_t _signature, long _payload, uint8_t _coalesce) {
+      if (_callback._function == NULL){
+        return;
+      }
+      if (_coalesce != EVENT_KEEP_ALL){
+        for (uint8_t i = 0, _index = _events_head; i < _events_count; i++, _index = _index + 1 < TWEAKLY_EVENT_QUEUE_SIZE ? _index + 1 : 0){
+          _event *_queued = &_events[_index];
+          if (_queued->_event_from == _from && _queued->_event_source == _source && _same_callable(_queued->_event_callable, _callback)){
+            _queued->_event_payload = _coalesce == EVENT_ADD ? _queued->_event_payload + _payload : _payload;
+            _events_stats.coalesced++;
+            return;
+          }
+        }
+      }
+      if (_events_count == TWEAKLY_EVENT_QUEUE_SIZE){
+        _events_stats.overflowed++;
+        _call_event(_callback, _signature, _payload);
+        return;
+      }
+      uint8_t _tail = (_events_head + _events_count) % TWEAKLY_EVENT_QUEUE_SIZE;
+      _events[_tail]._event_micros = micros();
+      _events[_tail]._event_payload = _payload;
+      _events[_tail]._event_callable = _callback;
+      _events[_tail]._event_source = _source;
+      _events[_tail]._event_from = _from;
+      _events[_tail]._event_signature = _signature;
+      _events_count++;
+      if (_events_count > _events_stats.maxDepth){
+        _events_stats.maxDepth = _events_count;
+      }
+    }
+
+    // eventBudget : microseconds TweaklyRun() may spend calling events in a pass, 0 calls them all
+    void eventBudget(unsigned long _budget_micros) {
+      _events_budget_micros = _budget_micros;
+    }
+
+    // getEventStats : depth, merges and latency of the queue
+    eventStats getEventStats() {
+      _events_stats.depth = _events_count;
+      return _events_stats;
+    }
+
+    // Loop for the queue : call events in order, at least one per pass, until the budget is spent
+    void Loop() {
+      if (_events_count == 0){
+        return;
+      }
+      unsigned long _start_micros = micros();
+      do {
+        _event _this_event = _events[_events_head];
+        _events_head = _events_head + 1 < TWEAKLY_EVENT_QUEUE_SIZE ? _events_head + 1 : 0;
+        _events_count--;
+        unsigned long _current_micros = micros();
+        if (_current_micros - _this_event._event_micros > _events_stats.maxLatencyMicros){
+          _events_stats.maxLatencyMicros = _current_micros - _this_event._event_micros;
+        }
+        _events_stats.dispatched++;
+        _call_event(_this_event._event_callable, _this_event._event_signature, _this_event._event_payload);
+      } while (_events_count > 0 && (_events_budget_micros == 0 || (unsigned long)(micros() - _start_micros) < _events_budget_micros));
+    }
+
+    // Idle while no event is queued
+    bool _events_idle() {
+      return _events_count == 0;
+    }
+
+    tweaklyrun::Module _events_module("events", Loop, MODULE_ORDER_EVENTS, NULL, _events_idle);
+
+    #else
+
+    inline void _post_event(uint8_t, uint16_t, const _callable &_callback, uint8_t _signature, long _payload, uint8_t) {
+      _call_event(_callback, _signature, _payload);
+    }
+
+    inline void eventBudget(unsigned long) { }
+
+    inline eventStats getEventStats() {
+      eventStats _stats = { 0, 0, 0, 0, 0, 0 };
+      return _stats;
+    }
+
+    inline void Loop() { }
+
+    #endif
+
+}
+
+#endif
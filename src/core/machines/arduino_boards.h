@@ -127,6 +127,85 @@ namespace arduino_boards
 
 #endif
 
+#if defined(TWEAKLY_PIN_CHANGE) && defined(__AVR__) && defined(PCICR)
+
+#define ARDUINO_PIN_CHANGE
+    
+    // Maximum number of pins watched by pin change interrupts
+    #ifndef TWEAKLY_MAX_PIN_CHANGES
+    #define TWEAKLY_MAX_PIN_CHANGES 8
+    #endif
+    
+    typedef void (*_pin_change_callback)(void *);
+    
+    //Struct for pins watched by pin change interrupts
+    struct _pin_changes {
+        volatile uint8_t *_input;
+        uint8_t _mask;
+        uint8_t _group;
+        uint8_t _level;
+        _pin_change_callback _callback;
+        void *_context;
+    };
+    
+    _pin_changes _pin_change_slots[TWEAKLY_MAX_PIN_CHANGES];
+    volatile uint8_t _pin_change_counter = 0;
+    
+    // Call the callback of every pin of a group whose level changed (a group shares one vector)
+    inline void _pin_change_dispatch(uint8_t _group) {
+        for (uint8_t i = 0; i < _pin_change_counter; i++) {
+            _pin_changes *_this_slot = &_pin_change_slots[i];
+            if (_this_slot->_group == _group) {
+                uint8_t _level = *_this_slot->_input & _this_slot->_mask;
+                if (_level != _this_slot->_level) {
+                    _this_slot->_level = _level;
+                    _this_slot->_callback(_this_slot->_context);
+                }
+            }
+        }
+    }
+    
+    // Call a callback on both edges of a pin, false when the pin has no pin change interrupt or the slots are over
+    bool attachPinChange(uint8_t _pin, _pin_change_callback _callback, void *_context) {
+        volatile uint8_t *_pcicr = digitalPinToPCICR(_pin);
+        volatile uint8_t *_pcmsk = digitalPinToPCMSK(_pin);
+        if (_pcicr == NULL || _pcmsk == NULL || _pin_change_counter >= TWEAKLY_MAX_PIN_CHANGES) {
+            return false;
+        }
+        _pin_changes *_new_slot = &_pin_change_slots[_pin_change_counter];
+        _new_slot->_input = portInputRegister(digitalPinToPort(_pin));
+        _new_slot->_mask = digitalPinToBitMask(_pin);
+        _new_slot->_group = digitalPinToPCICRbit(_pin);
+        _new_slot->_level = *_new_slot->_input & _new_slot->_mask;
+        _new_slot->_callback = _callback;
+        _new_slot->_context = _context;
+        uint8_t _sreg = SREG;
+        cli();
+        _pin_change_counter++;
+        *_pcmsk |= _BV(digitalPinToPCMSKbit(_pin));
+        *_pcicr |= _BV(digitalPinToPCICRbit(_pin));
+        SREG = _sreg;
+        return true;
+    }
+
+#endif
+
 }
 
+// Pin change vectors, defined only with TWEAKLY_PIN_CHANGE because SoftwareSerial and other libraries define them too
+#if defined(ARDUINO_PIN_CHANGE)
+#if defined(PCINT0_vect)
+ISR(PCINT0_vect) { arduino_boards::_pin_change_dispatch(0); }
+#endif
+#if defined(PCINT1_vect)
+ISR(PCINT1_vect) { arduino_boards::_pin_change_dispatch(1); }
+#endif
+#if defined(PCINT2_vect)
+ISR(PCINT2_vect) { arduino_boards::_pin_change_dispatch(2); }
+#endif
+#if defined(PCINT3_vect)
+ISR(PCINT3_vect) { arduino_boards::_pin_change_dispatch(3); }
+#endif
+#endif
+
 #endif
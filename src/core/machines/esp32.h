@@ -37,6 +37,26 @@
 #define ESP32_H
 
 #include "esp32-hal-ledc.h"
+#include "driver/ledc.h"
+
+//Pulse counter : only on the chips that have one (not on ESP32-C3 and the other RISC-V chips),
+//cores without soc_caps.h only build for ESP32 and ESP32-S2, which have it
+#if defined(__has_include)
+  #if __has_include("soc/soc_caps.h")
+    #include "soc/soc_caps.h"
+    #if defined(SOC_PCNT_SUPPORTED) && SOC_PCNT_SUPPORTED
+      #define ESP32_PCNT_SUPPORTED
+    #endif
+  #else
+    #define ESP32_PCNT_SUPPORTED
+  #endif
+#else
+  #define ESP32_PCNT_SUPPORTED
+#endif
+
+#if defined(ESP32_PCNT_SUPPORTED)
+  #include "driver/pcnt.h"
+#endif
 
 namespace esp32 {
 
@@ -44,12 +64,70 @@ namespace esp32 {
 unsigned int _esp32_channel_counter = 0;
 unsigned int _esp32_channel_max = 16;
 
+//Tone timer settings : 12 bits on the 80MHz APB clock keep every note divider inside the 10.8 bits timer divider
+#define ESP32_TONE_RESOLUTION 12
+#define ESP32_TONE_APB_CLOCK 80000000UL
+
+//Timer divider (10.8 fixed point) for a tone frequency
+constexpr uint32_t _esp32_tone_divider(uint32_t _frequency) {
+	return (uint32_t)(((uint64_t)ESP32_TONE_APB_CLOCK << 8) / ((uint64_t)_frequency << ESP32_TONE_RESOLUTION));
+}
+
+//Struct for note dividers
+struct _esp32_note_dividers {
+	uint16_t _frequency;
+	uint32_t _divider;
+};
+
+#define ESP32_NOTE(F) { F, _esp32_tone_divider(F) }
+
+//Dividers for NOTE_B0 ... NOTE_DS8 of the polyphonic module, sorted by frequency
+const _esp32_note_dividers _esp32_note_table[] = {
+	ESP32_NOTE(31),   ESP32_NOTE(33),   ESP32_NOTE(35),   ESP32_NOTE(37),   ESP32_NOTE(39),   ESP32_NOTE(41),
+	ESP32_NOTE(44),   ESP32_NOTE(46),   ESP32_NOTE(49),   ESP32_NOTE(52),   ESP32_NOTE(55),   ESP32_NOTE(58),
+	ESP32_NOTE(62),   ESP32_NOTE(65),   ESP32_NOTE(69),   ESP32_NOTE(73),   ESP32_NOTE(78),   ESP32_NOTE(82),
+	ESP32_NOTE(87),   ESP32_NOTE(93),   ESP32_NOTE(98),   ESP32_NOTE(104),  ESP32_NOTE(110),  ESP32_NOTE(117),
+	ESP32_NOTE(123),  ESP32_NOTE(131),  ESP32_NOTE(139),  ESP32_NOTE(147),  ESP32_NOTE(156),  ESP32_NOTE(165),
+	ESP32_NOTE(175),  ESP32_NOTE(185),  ESP32_NOTE(196),  ESP32_NOTE(208),  ESP32_NOTE(220),  ESP32_NOTE(233),
+	ESP32_NOTE(247),  ESP32_NOTE(262),  ESP32_NOTE(277),  ESP32_NOTE(294),  ESP32_NOTE(311),  ESP32_NOTE(330),
+	ESP32_NOTE(349),  ESP32_NOTE(370),  ESP32_NOTE(392),  ESP32_NOTE(415),  ESP32_NOTE(440),  ESP32_NOTE(466),
+	ESP32_NOTE(494),  ESP32_NOTE(523),  ESP32_NOTE(554),  ESP32_NOTE(587),  ESP32_NOTE(622),  ESP32_NOTE(659),
+	ESP32_NOTE(698),  ESP32_NOTE(740),  ESP32_NOTE(784),  ESP32_NOTE(831),  ESP32_NOTE(880),  ESP32_NOTE(932),
+	ESP32_NOTE(988),  ESP32_NOTE(1047), ESP32_NOTE(1109), ESP32_NOTE(1175), ESP32_NOTE(1245), ESP32_NOTE(1319),
+	ESP32_NOTE(1397), ESP32_NOTE(1480), ESP32_NOTE(1568), ESP32_NOTE(1661), ESP32_NOTE(1760), ESP32_NOTE(1865),
+	ESP32_NOTE(1976), ESP32_NOTE(2093), ESP32_NOTE(2217), ESP32_NOTE(2349), ESP32_NOTE(2489), ESP32_NOTE(2637),
+	ESP32_NOTE(2794), ESP32_NOTE(2960), ESP32_NOTE(3136), ESP32_NOTE(3322), ESP32_NOTE(3520), ESP32_NOTE(3729),
+	ESP32_NOTE(3951), ESP32_NOTE(4186), ESP32_NOTE(4435), ESP32_NOTE(4699), ESP32_NOTE(4978)
+};
+
+const uint8_t _esp32_note_table_size = sizeof(_esp32_note_table) / sizeof(_esp32_note_table[0]);
+
+//Find the divider of a note (binary search), returns 0 if the frequency is not a note
+uint32_t _esp32_note_divider(unsigned int _frequency) {
+	int _low = 0;
+	int _high = _esp32_note_table_size - 1;
+	while(_low <= _high) {
+		int _middle = (_low + _high) / 2;
+		if(_esp32_note_table[_middle]._frequency == _frequency) {
+			return _esp32_note_table[_middle]._divider;
+		}
+		if(_esp32_note_table[_middle]._frequency < _frequency) {
+			_low = _middle + 1;
+		} else {
+			_high = _middle - 1;
+		}
+	}
+	return 0;
+}
+
 //Enablers
 volatile bool _esp32_pwm_pad_exists { false };
 
 //Struct for esp32 pwm pads
 struct _esp32_pwm_pads{
     bool _attached;
+	bool _tone_mode;
+	unsigned int _tone_frequency;
 	uint8_t _channel;
 	unsigned long _frequency = 1500;
 	unsigned int _resolution = 10;
@@ -74,6 +152,8 @@ void _create_pad(uint8_t _pin) {
           _last_esp32_pad->_next_esp32_pad = _new_esp32_pad;
       }    
 	  _new_esp32_pad->_attached = false;
+	  _new_esp32_pad->_tone_mode = false;
+	  _new_esp32_pad->_tone_frequency = 0;
 	  ledcSetup(_new_esp32_pad->_channel, _new_esp32_pad->_frequency, _new_esp32_pad->_resolution);
 	  _last_esp32_pad = _new_esp32_pad;
 	  _esp32_pwm_pad_exists = true;
@@ -100,6 +180,7 @@ void setEsp32PadConfiguration(uint8_t _pin, unsigned long _new_frequency, unsign
 		   if(_this_esp32_pad->_pin == _pin) {
 		      _this_esp32_pad->_frequency = _new_frequency;
 		      _this_esp32_pad->_resolution = _new_resolution;
+		      _this_esp32_pad->_tone_mode = false;
 		      ledcSetup(_this_esp32_pad->_channel, _this_esp32_pad->_frequency, _this_esp32_pad->_resolution);
 		   }
 	   }
@@ -145,43 +226,89 @@ unsigned int getEsp32PadResolution(uint8_t _pin) {
 	return _resolution;
 }
 
-//Tone function for ESP32
+//Retune the timer of an attached tone channel without touching the pin
+void _esp32_retune(_esp32_pwm_pads *_this_esp32_pad, unsigned int _note) {
+	uint32_t _divider = _esp32_note_divider(_note);
+	if(_divider != 0) {
+		//Same mapping used by esp32-hal-ledc : 8 channels for each speed mode, 2 channels for each timer
+		ledc_timer_set((ledc_mode_t)(_this_esp32_pad->_channel / 8), (ledc_timer_t)((_this_esp32_pad->_channel / 2) % 4), _divider, ESP32_TONE_RESOLUTION, LEDC_APB_CLK);
+	} else {
+		ledcSetup(_this_esp32_pad->_channel, _note, ESP32_TONE_RESOLUTION);
+	}
+	_this_esp32_pad->_tone_frequency = _note;
+}
+
+//Tone function for ESP32 : the first note attaches the pin, the following notes only update the timer divider
 void tone(uint8_t _pin, int _note)
 {   
 	if(_esp32_pwm_pad_exists) {
 	  for (_esp32_pwm_pads *_this_esp32_pad = _first_esp32_pad; _this_esp32_pad != NULL; _this_esp32_pad = _this_esp32_pad->_next_esp32_pad){
 		 if(_this_esp32_pad->_pin == _pin) { 
+			if(_note <= 0) {
+				if(_this_esp32_pad->_attached) {
+					ledcWrite(_this_esp32_pad->_channel, 0);
+				}
+				_this_esp32_pad->_tone_frequency = 0;
+				return;
+			}
+			if(!_this_esp32_pad->_tone_mode) {
+			   ledcSetup(_this_esp32_pad->_channel, _note, ESP32_TONE_RESOLUTION);
+			   _this_esp32_pad->_tone_mode = true;
+			   _this_esp32_pad->_tone_frequency = _note;
+			}
 			if(!_this_esp32_pad->_attached) {
 			   ledcAttachPin(_this_esp32_pad->_pin, _this_esp32_pad->_channel);
-			   ledcWriteTone(_this_esp32_pad->_channel, _note);
 	           _this_esp32_pad->_attached = true;
 	        }
+			if((unsigned int)_note != _this_esp32_pad->_tone_frequency) {
+			   _esp32_retune(_this_esp32_pad, _note);
+			}
+			ledcWrite(_this_esp32_pad->_channel, 1 << (ESP32_TONE_RESOLUTION - 1));
 		} 
 	  }
 	}
 }
 
-//noTone function for ESP32
+//noTone function for ESP32 : mutes the channel and keeps the pin attached, so the next tone does not click.
+//The pin leaves the channel when the pad is written as a digital output again, see _release_pin
 void noTone(uint8_t _pin)
 {
    if(_esp32_pwm_pad_exists) {
      for (_esp32_pwm_pads *_this_esp32_pad = _first_esp32_pad; _this_esp32_pad != NULL; _this_esp32_pad = _this_esp32_pad->_next_esp32_pad){
 		if(_this_esp32_pad->_pin == _pin) { 
 			if(_this_esp32_pad->_attached) {
-                ledcDetachPin(_this_esp32_pad->_pin);
                 ledcWrite(_this_esp32_pad->_channel, 0);
-				_this_esp32_pad->_attached = false;
 	        }
 		  }
 	  }
    }
 }
 
+//Give a pin back to the GPIO : a pin left attached by noTone would ignore digitalWrite
+void _release_pin(uint8_t _pin) {
+   if(_esp32_pwm_pad_exists) {
+     for (_esp32_pwm_pads *_this_esp32_pad = _first_esp32_pad; _this_esp32_pad != NULL; _this_esp32_pad = _this_esp32_pad->_next_esp32_pad){
+		if(_this_esp32_pad->_pin == _pin && _this_esp32_pad->_attached) { 
+			ledcWrite(_this_esp32_pad->_channel, 0);
+			ledcDetachPin(_pin);
+			pinMode(_pin, OUTPUT);
+			_this_esp32_pad->_attached = false;
+		}
+	  }
+   }
+}
+
 //analogWrite function for ESP32
 void analogWrite(uint8_t _pin, uint16_t _new_pwm_value) {
    if(_esp32_pwm_pad_exists) {
    for (_esp32_pwm_pads *_this_esp32_pad = _first_esp32_pad; _this_esp32_pad != NULL; _this_esp32_pad = _this_esp32_pad->_next_esp32_pad){
 		if(_this_esp32_pad->_pin == _pin) { 
+			if(_this_esp32_pad->_tone_mode) {
+				//Restore the PWM configuration of the pad after a melody
+				ledcSetup(_this_esp32_pad->_channel, _this_esp32_pad->_frequency, _this_esp32_pad->_resolution);
+				_this_esp32_pad->_tone_mode = false;
+				_this_esp32_pad->_tone_frequency = 0;
+			}
 			if(!_this_esp32_pad->_attached) {
                 ledcAttachPin(_pin, _this_esp32_pad->_channel);
                 _this_esp32_pad->_attached = true;
@@ -193,6 +320,106 @@ void analogWrite(uint8_t _pin, uint16_t _new_pwm_value) {
     }
 }
 
+#if defined(ESP32_PCNT_SUPPORTED)
+
+//Pulse counter settings for encoders
+#define ESP32_PCNT_LIMIT 16384            // -> the hardware counter is folded into a 32 bits position every ESP32_PCNT_LIMIT counts
+#define ESP32_PCNT_FILTER 250             // -> pulses shorter than this number of APB cycles (80MHz) are ignored
+
+//Variables
+uint8_t _esp32_pcnt_counter = 0;
+bool _esp32_pcnt_service_installed = false;
+
+//Overflows of each pulse counter unit
+volatile long _esp32_pcnt_overflow[PCNT_UNIT_MAX];
+
+//Last position read from each unit
+long _esp32_pcnt_last_position[PCNT_UNIT_MAX];
+
+//Pulse counter interrupt : the unit restarted from zero at a limit, move the limit into the overflow
+void IRAM_ATTR _esp32_pcnt_isr(void *_arg) {
+	pcnt_unit_t _unit = (pcnt_unit_t)(intptr_t)_arg;
+	uint32_t _status = 0;
+	pcnt_get_event_status(_unit, &_status);
+	if(_status & PCNT_EVT_H_LIM) {
+		_esp32_pcnt_overflow[_unit] += ESP32_PCNT_LIMIT;
+	}
+	if(_status & PCNT_EVT_L_LIM) {
+		_esp32_pcnt_overflow[_unit] -= ESP32_PCNT_LIMIT;
+	}
+}
+
+//Configure a free pulse counter unit as a full quadrature decoder, returns the unit or -1 if all units are used
+int _esp32_pcnt_encoder_attach(uint8_t _clk_pin, uint8_t _dt_pin) {
+	if(_esp32_pcnt_counter >= PCNT_UNIT_MAX) {
+		return -1;
+	}
+	pcnt_unit_t _unit = (pcnt_unit_t)_esp32_pcnt_counter;
+	//Channel 0 counts the CLK edges, DT gives the direction
+	pcnt_config_t _config = {};
+	_config.pulse_gpio_num = _clk_pin;
+	_config.ctrl_gpio_num = _dt_pin;
+	_config.lctrl_mode = PCNT_MODE_REVERSE;
+	_config.hctrl_mode = PCNT_MODE_KEEP;
+	_config.pos_mode = PCNT_COUNT_INC;
+	_config.neg_mode = PCNT_COUNT_DEC;
+	_config.counter_h_lim = ESP32_PCNT_LIMIT;
+	_config.counter_l_lim = -ESP32_PCNT_LIMIT;
+	_config.unit = _unit;
+	_config.channel = PCNT_CHANNEL_0;
+	if(pcnt_unit_config(&_config) != ESP_OK) {
+		return -1;
+	}
+	//Channel 1 counts the DT edges, CLK gives the direction
+	_config.pulse_gpio_num = _dt_pin;
+	_config.ctrl_gpio_num = _clk_pin;
+	_config.pos_mode = PCNT_COUNT_DEC;
+	_config.neg_mode = PCNT_COUNT_INC;
+	_config.channel = PCNT_CHANNEL_1;
+	if(pcnt_unit_config(&_config) != ESP_OK) {
+		return -1;
+	}
+	pcnt_set_filter_value(_unit, ESP32_PCNT_FILTER);
+	pcnt_filter_enable(_unit);
+	pcnt_event_enable(_unit, PCNT_EVT_H_LIM);
+	pcnt_event_enable(_unit, PCNT_EVT_L_LIM);
+	pcnt_counter_pause(_unit);
+	pcnt_counter_clear(_unit);
+	_esp32_pcnt_overflow[_unit] = 0;
+	_esp32_pcnt_last_position[_unit] = 0;
+	if(!_esp32_pcnt_service_installed) {
+		pcnt_isr_service_install(0);
+		_esp32_pcnt_service_installed = true;
+	}
+	pcnt_isr_handler_add(_unit, _esp32_pcnt_isr, (void *)(intptr_t)_unit);
+	pcnt_counter_resume(_unit);
+	_esp32_pcnt_counter++;
+	return _unit;
+}
+
+//Get the 32 bits position of a pulse counter unit
+//When the counter has restarted from zero at a limit but the interrupt has not moved the limit into the overflow yet,
+//the sum is off by ESP32_PCNT_LIMIT : an encoder cannot move half the limit between two reads, so such a jump is folded back
+long _esp32_pcnt_encoder_position(uint8_t _unit) {
+	long _overflow;
+	int16_t _count;
+	do {
+		_overflow = _esp32_pcnt_overflow[_unit];
+		pcnt_get_counter_value((pcnt_unit_t)_unit, &_count);
+	} while(_overflow != _esp32_pcnt_overflow[_unit]);
+	long _position = _overflow + _count;
+	long _jump = _position - _esp32_pcnt_last_position[_unit];
+	if(_jump > ESP32_PCNT_LIMIT / 2) {
+		_position -= ESP32_PCNT_LIMIT;
+	} else if(_jump < -ESP32_PCNT_LIMIT / 2) {
+		_position += ESP32_PCNT_LIMIT;
+	}
+	_esp32_pcnt_last_position[_unit] = _position;
+	return _position;
+}
+
+#endif
+
 }
 
 
@@ -35,84 +35,247 @@
 namespace asyncer
 {
 
-  int _await_counter = 0;
-  int _cur_await = 0;
-  int _await_set_counter = 0;
-  bool _async = false;
-
-  #define TWEAKLY_MAX_AWAIT_SLEEP_TIMER 10
-
   #define TWEAKLY_ROLLUP                  \
-          _async = true;                  \
           do {
   #define END_ROLLUP                      \
-          break; } while(_async);
-
-  struct _awaitDelayList {
-    int _cur_index;
-    unsigned long _cur_millis;
-    unsigned long _cur_previous_millis;
-    bool _set;
-    bool _enabled;
+          } while(0);
+
+  // Timer of a sleep_for : each sleep_for owns one, a static created where it is written,
+  // so there are exactly as many as the sketch uses and nothing to scan in Loop
+  struct _awaitSlot {
+    unsigned long _previous_millis;
+    bool _armed;
   };
 
-  struct _awaitDelayList _awaitDelayListArray[TWEAKLY_MAX_AWAIT_SLEEP_TIMER];
+  // True while the sleep_for has to skip the rest of its rollup
+  bool awaitControl(_awaitSlot &_slot, unsigned long _milliseconds) {
+    unsigned long _current_millis = millis();
+    if (!_slot._armed) {
+      _slot._armed = true;
+      _slot._previous_millis = _current_millis;
+      return true;
+    }
+    if ((unsigned long)(_current_millis - _slot._previous_millis) >= _milliseconds) {
+      _slot._previous_millis = _current_millis;
+      return false;
+    }
+    return true;
+  }
+
+  // A single statement, so sleep_for also works as the body of an if or a loop without braces;
+  // the static lives in a statement expression, one per place the macro is written
+  #define sleep_for(M)                                            \
+          if( !asyncer::awaitControl( *({ static asyncer::_awaitSlot _slot; &_slot; }), M ) ) { } else break
+
+  // Coroutines : tasks written as straight code that pause with await_* and resume where they stopped.
+  // Locals do not survive an await, keep the state of a task in members of its class,
+  // and write at most one await per line.
+  //
+  //   class Blink : public Coroutine {
+  //     uint8_t times;
+  //     void run() {
+  //       COROUTINE_BEGIN
+  //       for (times = 0; times < 10; times++) {
+  //         led.toggle();
+  //         await_ms(200);
+  //       }
+  //       COROUTINE_END
+  //     }
+  //   };
+  //
+  // A coroutine runs from the first TweaklyRun. One that another coroutine runs with await_coroutine
+  // is created stopped instead, with Coroutine(false), and each await_coroutine starts it again :
+  //
+  //   class Fade : public Coroutine {
+  //     public :
+  //     Fade() : Coroutine(false) {}
+  //     ...
+  //   };
+
+  // Coroutine states
+  #define COROUTINE_READY 0                 // -> resumed on every pass
+  #define COROUTINE_SLEEPING 1              // -> resumed when its await_ms time is over
+  #define COROUTINE_WAITING 2               // -> resumed when a pad event or a timer dispatch happened
+  #define COROUTINE_DONE 3
+  #define COROUTINE_STOPPED 4
+
+  // Enablers
+  volatile bool _coroutine_exists { false };
 
-  bool awaitControl(int _timer, unsigned long _milliseconds) {
-      if(!_awaitDelayListArray[_timer]._set) {
-        _awaitDelayListArray[_timer]._set = true;
+  class Coroutine;
+  Coroutine *_first_coroutine = NULL, *_last_coroutine = NULL;
+
+  // The scheduler sleeps until the nearest await_ms, unless a coroutine polls or an event happens
+  bool _coroutine_reschedule = true;
+  unsigned long _coroutine_wake_millis = 0;
+  unsigned int _coroutine_events_serial = 0;
+
+  class Coroutine {
+    protected :
+    uint16_t        _co_line;
+    uint8_t         _co_state;
+    unsigned long   _co_sleep_start;
+    unsigned long   _co_sleep_millis;
+    unsigned int    _co_count;
+    Coroutine *     _next_coroutine;
+    friend void _coroutines_loop();
+    public :
+    Coroutine(bool _started = true) {
+      _co_line = 0;
+      _co_state = _started ? COROUTINE_READY : COROUTINE_STOPPED;
+      _co_sleep_start = 0;
+      _co_sleep_millis = 0;
+      _co_count = 0;
+      _next_coroutine = NULL;
+      if (_first_coroutine == NULL){
+        _first_coroutine = this;
+      }else{
+        _last_coroutine->_next_coroutine = this;
       }
-      if(_timer <= _await_counter - 1) {
-        bool _break = false;
-        _awaitDelayListArray[_timer]._cur_millis = millis();
-         if((unsigned long) _awaitDelayListArray[_timer]._cur_millis - _awaitDelayListArray[_timer]._cur_previous_millis >= _milliseconds) {
-          _awaitDelayListArray[_timer]._cur_previous_millis = _awaitDelayListArray[_timer]._cur_millis;
-          _break = false;
-         } else {
-          _break = true;
-         }
-        return _break;
-      } else {
-        return false;
+      _last_coroutine = this;
+      if (!_coroutine_exists){
+        _coroutine_exists = true;
       }
+    }
+    // Body of the coroutine, between COROUTINE_BEGIN and COROUTINE_END
+    virtual void run() = 0;
+    void start();
+    void stop();
+    bool running();
+  };
+
+  // Coroutine Class start Function : run the coroutine again from its beginning
+  void Coroutine::start() {
+    this->_co_line = 0;
+    this->_co_state = COROUTINE_READY;
+    _coroutine_reschedule = true;
   }
-  
-  #define sleep_for(M)                                            \
-          if( awaitControl( _cur_await, M ) && _async ){          \
-            if( _cur_await < _await_counter ) {                   \
-               _cur_await++;                                      \
-            }                                                     \
-            _async = false;                                       \
-            break;                                                \
-          } else {                                                \
-            if( _cur_await < _await_counter ) {                   \
-              _async = false;                                     \
-              _cur_await++;                                       \
-            }                                                     \
-          }                                                       \
-  
 
-  void Setup() {
-    for(int i = 0; i < TWEAKLY_MAX_AWAIT_SLEEP_TIMER; i++) {
-      _awaitDelayListArray[i] = (_awaitDelayList) {_await_counter, millis(), millis(), false, false};
-      _await_counter++;
-    }
+  // Coroutine Class stop Function : the coroutine is not resumed anymore, until start
+  void Coroutine::stop() {
+    this->_co_state = COROUTINE_STOPPED;
   }
 
-  void Loop() {
-    for(int i = 0; i < TWEAKLY_MAX_AWAIT_SLEEP_TIMER; i++) {
-      if(_awaitDelayListArray[i]._set) {
-        if(!_awaitDelayListArray[i]._enabled) {
-         _awaitDelayListArray[i]._enabled = true;
-         _await_set_counter++;
+  // Coroutine Class running Function : false once the coroutine reached COROUTINE_END or was stopped
+  bool Coroutine::running() {
+    return this->_co_state != COROUTINE_DONE && this->_co_state != COROUTINE_STOPPED;
+  }
+
+  // The resume point of a wait is entered by falling through from the line before it, said so for -Wimplicit-fallthrough
+  #if defined(__GNUC__) && __GNUC__ >= 7
+  #define _COROUTINE_FALLTHROUGH __attribute__((fallthrough))
+  #elif defined(__clang__)
+  #define _COROUTINE_FALLTHROUGH [[clang::fallthrough]]
+  #else
+  #define _COROUTINE_FALLTHROUGH
+  #endif
+
+  #define COROUTINE_BEGIN                                                    \
+          switch (this->_co_line) { case 0:
+  #define COROUTINE_END                                                      \
+          } this->_co_line = 0; this->_co_state = COROUTINE_DONE; return;
+
+  // Return to TweaklyRun in _state until _condition holds, then continue from here
+  #define _COROUTINE_AWAIT(_state, _condition)                               \
+          do {                                                               \
+            this->_co_line = __LINE__; _COROUTINE_FALLTHROUGH;               \
+            case __LINE__:                                                   \
+            if (!(_condition)) { this->_co_state = _state; return; }         \
+            this->_co_state = COROUTINE_READY;                               \
+          } while (0)
+
+  #define await_until(C)                                                     \
+          _COROUTINE_AWAIT(COROUTINE_READY, C)
+  #define await_ms(M)                                                        \
+          do {                                                               \
+            this->_co_sleep_start = millis(); this->_co_sleep_millis = (M);  \
+            _COROUTINE_AWAIT(COROUTINE_SLEEPING, (unsigned long)(millis() - this->_co_sleep_start) >= this->_co_sleep_millis); \
+          } while (0)
+  #define await_event(P, E)                                                  \
+          do {                                                               \
+            this->_co_count = (P).events(E);                                 \
+            _COROUTINE_AWAIT(COROUTINE_WAITING, (P).events(E) != (uint8_t)this->_co_count); \
+          } while (0)
+  #define await_timer(T)                                                     \
+          do {                                                               \
+            this->_co_count = (T).dispatches();                              \
+            _COROUTINE_AWAIT(COROUTINE_WAITING, (T).dispatches() != this->_co_count); \
+          } while (0)
+  // Start the coroutine C from its beginning and wait for it to reach COROUTINE_END or be stopped
+  #define await_coroutine(C)                                                 \
+          do {                                                               \
+            (C).start();                                                     \
+            _COROUTINE_AWAIT(COROUTINE_READY, !(C).running());               \
+          } while (0)
+  #define await_next()                                                       \
+          do {                                                               \
+            this->_co_line = __LINE__; this->_co_state = COROUTINE_READY;    \
+            return; case __LINE__: ;                                         \
+          } while (0)
+
+  // Resume the coroutines whose wait is over and find when the next one wakes up
+  void _coroutines_loop() {
+    unsigned long _current_millis = millis();
+    bool _events = _coroutine_events_serial != tweaklypads::_tweakly_events_serial;
+    if (!_coroutine_reschedule && !_events && (long)(_current_millis - _coroutine_wake_millis) < 0){
+      return;
+    }
+    _coroutine_events_serial = tweaklypads::_tweakly_events_serial;
+    _coroutine_reschedule = false;
+    unsigned long _sleep = 0xFFFFFFFFUL;
+    for (Coroutine *_this_coroutine = _first_coroutine; _this_coroutine != NULL; _this_coroutine = _this_coroutine->_next_coroutine){
+      switch (_this_coroutine->_co_state){
+        case COROUTINE_READY :
+          _this_coroutine->run();
+        break;
+        case COROUTINE_SLEEPING :
+          if ((unsigned long)(_current_millis - _this_coroutine->_co_sleep_start) >= _this_coroutine->_co_sleep_millis){
+            _this_coroutine->run();
+          }
+        break;
+        case COROUTINE_WAITING :
+          if (_events){
+            _this_coroutine->run();
+          }
+        break;
+      }
+      if (_this_coroutine->_co_state == COROUTINE_READY){
+        _coroutine_reschedule = true;
+      }
+      if (_this_coroutine->_co_state == COROUTINE_SLEEPING){
+        unsigned long _elapsed = millis() - _this_coroutine->_co_sleep_start;
+        unsigned long _left = _elapsed < _this_coroutine->_co_sleep_millis ? _this_coroutine->_co_sleep_millis - _elapsed : 0;
+        if (_left < _sleep){
+          _sleep = _left;
         }
       }
     }
-    if(_cur_await == _await_set_counter) { 
-      _cur_await = 0; 
-    } 
+    if (_sleep > 0x7FFFFFFFUL){
+      _sleep = 0x7FFFFFFFUL;
+    }
+    _coroutine_wake_millis = millis() + _sleep;
   }
 
+  void Setup() {
+  }
+
+  void Loop() {
+    if (_coroutine_exists){
+      _coroutines_loop();
+    }
+  }
+
+  // Idle while there are no coroutines, asleep until the nearest await_ms or the next event
+  bool _coroutines_idle() {
+    return !_coroutine_exists;
+  }
+
+  unsigned long _coroutines_deadline() {
+    return _coroutine_reschedule || _coroutine_events_serial != tweaklypads::_tweakly_events_serial ? millis() : _coroutine_wake_millis;
+  }
+
+  tweaklyrun::Module _coroutines_module("asyncer", Loop, MODULE_ORDER_STATEMENTS, Setup, _coroutines_idle, _coroutines_deadline);
+
 }
 
 #endif
@@ -0,0 +1,203 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * MONITOR MODULE FOR TWEAKLY
+ *
+ * Measures the loop period, the time between two calls of TweaklyRun(), and the time
+ * TweaklyRun() itself takes. Debounce, encoders and timers are only as accurate as the period.
+ * Both go in histograms of MONITOR_BUCKETS power of two buckets : bucket 0 holds 0us,
+ * bucket n the times from 2^(n-1) to 2^n - 1 us, the last one everything longer.
+ * Enable it with #define TWEAKLY_MONITOR before #include "Tweakly.h",
+ * without it TweaklyRun() is not measured at all.
+ *
+ */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+namespace tweaklymonitor {
+
+    #define MONITOR_BUCKETS 16
+
+    // Type definition
+    typedef void (*_monitor_callback)(unsigned long);
+
+    // Struct for the loop statistics
+    struct loopStats {
+      unsigned long passes;                   // -> periods measured
+      unsigned long lastPeriodMicros;         // -> last time between two TweaklyRun
+      unsigned long maxPeriodMicros;          // -> longest time between two TweaklyRun
+      unsigned long lastRunMicros;            // -> last time spent in TweaklyRun
+      unsigned long maxRunMicros;             // -> longest time spent in TweaklyRun
+      unsigned long overBudget;               // -> periods longer than the budget
+    };
+
+    #if defined(TWEAKLY_MONITOR)
+
+    unsigned long _monitor_period_histogram[MONITOR_BUCKETS];
+    unsigned long _monitor_run_histogram[MONITOR_BUCKETS];
+    loopStats _monitor_stats = { 0, 0, 0, 0, 0, 0 };
+    unsigned long _monitor_previous_micros = 0;
+    bool _monitor_started = false;
+    unsigned long _monitor_budget_micros = 0;
+    _monitor_callback _monitor_budget_callback = NULL;
+
+    // Bucket of a time : the number of bits of it
+    inline uint8_t _monitor_bucket(unsigned long _micros) {
+      if (_micros == 0){
+        return 0;
+      }
+      uint8_t _bits = sizeof(unsigned long) * 8 - __builtin_clzl(_micros);
+      return _bits < MONITOR_BUCKETS ? _bits : MONITOR_BUCKETS - 1;
+    }
+
+    // Start of TweaklyRun : measure the period since the previous one
+    inline unsigned long _monitor_begin() {
+      unsigned long _current_micros = micros();
+      if (_monitor_started){
+        unsigned long _period = _current_micros - _monitor_previous_micros;
+        _monitor_period_histogram[_monitor_bucket(_period)]++;
+        _monitor_stats.passes++;
+        _monitor_stats.lastPeriodMicros = _period;
+        if (_period > _monitor_stats.maxPeriodMicros){
+          _monitor_stats.maxPeriodMicros = _period;
+        }
+        if (_monitor_budget_micros > 0 && _period > _monitor_budget_micros){
+          _monitor_stats.overBudget++;
+          if (_monitor_budget_callback != NULL){
+            _monitor_budget_callback(_period);
+          }
+        }
+      }
+      _monitor_started = true;
+      _monitor_previous_micros = _current_micros;
+      return _current_micros;
+    }
+
+    // End of TweaklyRun : measure the time it took
+    inline void _monitor_end(unsigned long _start_micros) {
+      unsigned long _run = micros() - _start_micros;
+      _monitor_run_histogram[_monitor_bucket(_run)]++;
+      _monitor_stats.lastRunMicros = _run;
+      if (_run > _monitor_stats.maxRunMicros){
+        _monitor_stats.maxRunMicros = _run;
+      }
+    }
+
+    // Upper bound of the bucket holding the _percent percentile of a histogram
+    unsigned long _monitor_percentile(unsigned long *_histogram, uint8_t _percent, unsigned long _max) {
+      unsigned long _total = 0;
+      for (uint8_t i = 0; i < MONITOR_BUCKETS; i++){
+        _total += _histogram[i];
+      }
+      if (_total == 0){
+        return 0;
+      }
+      if (_percent > 100){
+        _percent = 100;
+      }
+      // Split so that _total * _percent cannot overflow after 43 million passes
+      unsigned long _target = _total / 100 * _percent + _total % 100 * _percent / 100;
+      unsigned long _count = 0;
+      for (uint8_t i = 0; i < MONITOR_BUCKETS - 1; i++){
+        _count += _histogram[i];
+        if (_count >= _target && _count > 0){
+          unsigned long _bound = i == 0 ? 0 : (1UL << i) - 1;
+          return _bound < _max ? _bound : _max;
+        }
+      }
+      return _max;
+    }
+
+    // loopBudget : call _callback with the period every time it is longer than _budget_micros, 0 disables it
+    void loopBudget(unsigned long _budget_micros, _monitor_callback _callback = NULL) {
+      _monitor_budget_micros = _budget_micros;
+      _monitor_budget_callback = _callback;
+    }
+
+    // getLoopStats : periods and durations of TweaklyRun
+    loopStats getLoopStats() {
+      return _monitor_stats;
+    }
+
+    // loopPercentile : the period under which _percent of the passes stay, rounded up to its bucket
+    unsigned long loopPercentile(uint8_t _percent) {
+      return _monitor_percentile(_monitor_period_histogram, _percent, _monitor_stats.maxPeriodMicros);
+    }
+
+    // runPercentile : the duration of TweaklyRun under which _percent of the passes stay, rounded up to its bucket
+    unsigned long runPercentile(uint8_t _percent) {
+      return _monitor_percentile(_monitor_run_histogram, _percent, _monitor_stats.maxRunMicros);
+    }
+
+    // loopReset : forget every measure, the budget is kept
+    void loopReset() {
+      memset(_monitor_period_histogram, 0, sizeof(_monitor_period_histogram));
+      memset(_monitor_run_histogram, 0, sizeof(_monitor_run_histogram));
+      memset(&_monitor_stats, 0, sizeof(_monitor_stats));
+      _monitor_started = false;
+    }
+
+    // loopDump : print the histograms as "bucket upper_bound periods runs" lines, then the maximums
+    void loopDump(Print *_stream) {
+      if (_stream == NULL){
+        return;
+      }
+      for (uint8_t i = 0; i < MONITOR_BUCKETS; i++){
+        if (_monitor_period_histogram[i] == 0 && _monitor_run_histogram[i] == 0){
+          continue;
+        }
+        _stream->print((unsigned int)i);
+        _stream->print(' ');
+        _stream->print(i == 0 ? 0UL : (1UL << i) - 1);
+        _stream->print(' ');
+        _stream->print(_monitor_period_histogram[i]);
+        _stream->print(' ');
+        _stream->println(_monitor_run_histogram[i]);
+      }
+      _stream->print("max ");
+      _stream->print(_monitor_stats.maxPeriodMicros);
+      _stream->print(' ');
+      _stream->println(_monitor_stats.maxRunMicros);
+    }
+
+    #else
+
+    inline unsigned long _monitor_begin() { return 0; }
+    inline void _monitor_end(unsigned long) { }
+
+    inline void loopBudget(unsigned long, _monitor_callback = NULL) { }
+
+    inline loopStats getLoopStats() {
+      loopStats _stats = { 0, 0, 0, 0, 0, 0 };
+      return _stats;
+    }
+
+    inline unsigned long loopPercentile(uint8_t) { return 0; }
+    inline unsigned long runPercentile(uint8_t) { return 0; }
+    inline void loopReset() { }
+    inline void loopDump(Print *) { }
+
+    #endif
+
+}
+
+#endif
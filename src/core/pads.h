@@ -36,12 +36,26 @@ namespace tweaklypads {
 
 // Type definition
 typedef void (*_pad_callback)();
+typedef void (*_pad_context_callback)(void *);
 
 // Variables
 unsigned long _pad_button_default_debounce_millis  = 50;
 unsigned long _pad_button_default_long_press_millis = 1200;
 unsigned long _pad_button_default_rapid_action_delay = 200;
 
+// Write a digital output pad; on ESP32 the pin first leaves the LEDC channel a melody left it on
+inline void _pad_write(uint8_t _pin, uint8_t _value) {
+  #if defined(ARDUINO_ARCH_ESP32)
+  esp32::_release_pin(_pin);
+  #endif
+  digitalWrite(_pin, _value);
+}
+
+// Bumped by every pad event and timer dispatch, lets waiting coroutines sleep until something happens
+unsigned int _tweakly_events_serial = 0;
+// Bumped when the debounced level of an input pad changes, lets inputHunters skip passes with no change
+unsigned int _pad_levels_serial = 0;
+
 // Pad event
 #define CLICK 0
 #define DOUBLE_CLICK 1
@@ -49,6 +63,7 @@ unsigned long _pad_button_default_rapid_action_delay = 200;
 #define RELEASE 3
 #define TO_ON 4
 #define TO_OFF 5
+#define PAD_EVENTS 6
 
 // Definitions for PWM and ANALOG pin
 #ifndef INPUT_PULLDOWN
@@ -91,6 +106,8 @@ struct _pads{
   bool           _pad_previous_status;
   bool           _pad_debounced_status;
   bool           _pad_debounced_start_status;
+  bool           _pad_level_candidate;
+  unsigned long  _pad_level_since;
   bool           _pad_switch_status;
   bool           _pad_switch_release_button;
   bool           _pad_button_releasing;
@@ -108,12 +125,13 @@ struct _pads{
   unsigned long  _pad_debounce_current_millis;
   unsigned long  _pad_debounce_previous_millis;
   unsigned long  _pad_debounce_delay_millis;
-  _pad_callback _double_click_callback_function;
-  _pad_callback _click_callback_function;
-  _pad_callback _long_press_callback_function;
-  _pad_callback _release_callback_function;
-  _pad_callback _to_on_callback_function;
-  _pad_callback _to_off_callback_function;
+  tweaklyevents::_callable _double_click_callback_function;
+  tweaklyevents::_callable _click_callback_function;
+  tweaklyevents::_callable _long_press_callback_function;
+  tweaklyevents::_callable _release_callback_function;
+  tweaklyevents::_callable _to_on_callback_function;
+  tweaklyevents::_callable _to_off_callback_function;
+  uint8_t        _pad_event_counts[PAD_EVENTS];
   _pads *        _next_pad = NULL;
 };
 
@@ -137,24 +155,37 @@ struct _pwm_pads{
 
 _pads     *_first_pad =        NULL, *_last_pad =  NULL;
 _pwm_pads *_first_pwm_pad =    NULL, *_last_pwm_pad =  NULL;
+tweaklystorage::_records<_pads, TWEAKLY_STATIC_PADS> _pads_storage;
+tweaklystorage::_records<_pwm_pads, TWEAKLY_STATIC_PWM_PADS> _pwm_pads_storage;
 
 void nullCallback() {
   //null callback
 }
 
+// Count an event of a pad and post its callback
+inline void _pad_event(_pads *_this_pad, uint8_t _event, const tweaklyevents::_callable &_callback) {
+  TWEAKLY_TRACE_EVENT(TRACE_PAD_EVENT, _this_pad->_pad_number, _event);
+  _this_pad->_pad_event_counts[_event]++;
+  _tweakly_events_serial++;
+  tweaklyevents::_post_event(EVENT_FROM_PAD, _this_pad->_pad_number, _callback, EVENT_CALL_VOID, _event, EVENT_KEEP_ALL);
+}
+
 // Pad class: initialize a pin of your board 
 class Pad{
   private : 
   uint8_t _this_pad_number;
   uint8_t _this_pad_mode;
+  void _set_event(uint8_t _event, const tweaklyevents::_callable &_callback);
   public :
+  template <typename _static_check = void>
   Pad(uint8_t _pad_number, uint8_t _pad_mode = OUTPUT, const char *_pad_class = "nope", uint8_t _pad_start_value = 0, uint8_t _pad_min_value = 0, uint8_t _pad_max_value = 255) {
+    _TWEAKLY_REQUIRES(TWEAKLY_STATIC_PADS + TWEAKLY_STATIC_PWM_PADS, "a Pad needs TWEAKLY_STATIC_PADS or TWEAKLY_STATIC_PWM_PADS in static mode");
     _this_pad_number = _pad_number;
     _this_pad_mode = _pad_mode;
     if(_pad_mode != ANALOG_INPUT) {
       if(_pad_mode != PWM_OUTPUT) {
         // If the pin is set in INPUT, INPUT_PULLUP, INPUT_PULLDOWN or OUTPUT mode
-        _pads *_new_pad = new _pads;
+        _pads *_new_pad = _pads_storage.take();
         _new_pad->_pad_class = _pad_class;
         _new_pad->_pad_number = _pad_number;
         _new_pad->_pad_mode = _pad_mode;
@@ -162,6 +193,7 @@ class Pad{
         _new_pad->_pad_button_releasing = false;
         _new_pad->_pad_button_act_press = false;
         _new_pad->_pad_locked = UNLOCK;
+        memset(_new_pad->_pad_event_counts, 0, PAD_EVENTS);
         if (_first_pad == NULL){
           _first_pad = _new_pad;
         }else{
@@ -171,16 +203,18 @@ class Pad{
           pinMode(_pad_number, _pad_mode);
           _new_pad->_pad_previous_status = _pad_start_value;
           _new_pad->_pad_debounce_delay_millis = _pad_button_default_debounce_millis;
-          _new_pad->_pad_debounced_status = 0;
+          _new_pad->_pad_debounced_status = _pad_mode == INPUT ? !digitalRead(_pad_number) : digitalRead(_pad_number);
+          _new_pad->_pad_level_candidate = _new_pad->_pad_debounced_status;
+          _new_pad->_pad_level_since = millis();
           _new_pad->_pad_switch_status = 0;
           _new_pad->_pad_switch_release_button = 0;
           _new_pad->_pad_old_status = digitalRead(_new_pad->_pad_number);
           if(_pad_mode == INPUT || _pad_mode == INPUT_PULLUP || _pad_mode == INPUT_PULLDOWN) {
             _new_pad->_pad_rapid_action_time = millis();
-            _new_pad->_click_callback_function = nullCallback;
-            _new_pad->_release_callback_function = nullCallback;
-            _new_pad->_double_click_callback_function = nullCallback;
-            _new_pad->_long_press_callback_function = nullCallback;
+            _new_pad->_click_callback_function = tweaklyevents::_make_callable(nullCallback);
+            _new_pad->_release_callback_function = tweaklyevents::_make_callable(nullCallback);
+            _new_pad->_double_click_callback_function = tweaklyevents::_make_callable(nullCallback);
+            _new_pad->_long_press_callback_function = tweaklyevents::_make_callable(nullCallback);
             _new_pad->_pad_rapid_action_delay = _pad_button_default_rapid_action_delay;
             _new_pad->_pad_long_action_time = _pad_button_default_long_press_millis - _pad_button_default_rapid_action_delay;
           }
@@ -195,8 +229,8 @@ class Pad{
             _new_pad->_pad_output_to_off = false;
             _new_pad->_pad_output_to_on = true;
           }
-          _new_pad->_to_off_callback_function = nullCallback;
-          _new_pad->_to_on_callback_function = nullCallback;
+          _new_pad->_to_off_callback_function = tweaklyevents::_make_callable(nullCallback);
+          _new_pad->_to_on_callback_function = tweaklyevents::_make_callable(nullCallback);
         }
         _last_pad = _new_pad;
         if (!_pad_exists){
@@ -205,7 +239,7 @@ class Pad{
       }
       if(_pad_mode == PWM_OUTPUT || _pad_mode == MELODY_OUTPUT) {
         // If the pin is set in PWM_OUTPUT mode 
-        _pwm_pads *_new_pwm_pad = new _pwm_pads;
+        _pwm_pads *_new_pwm_pad = _pwm_pads_storage.take();
         _new_pwm_pad->_pwm_pad_number = _pad_number;
         _new_pwm_pad->_pwm_pad_locked = UNLOCK;
         if (_first_pwm_pad == NULL){
@@ -253,6 +287,8 @@ class Pad{
   uint32_t read();
   uint8_t pinNumber();
   void onEvent(uint8_t _event, _pad_callback _callback);
+  void onEvent(uint8_t _event, _pad_context_callback _callback, void *_context);
+  uint8_t events(uint8_t _event);
   void adjust(padSettings _new_settings);
 
   //operator "="
@@ -277,8 +313,30 @@ void Pad::adjust(padSettings _new_settings) {
 }
 
 
+// Pad Class events Function : how many times an event happened, wrapping at 256, to notice new events
+uint8_t Pad::events(uint8_t _event) {
+  if (_pad_exists && _event < PAD_EVENTS){
+    for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
+      if (_this_pad->_pad_number == this->_this_pad_number){
+        return _this_pad->_pad_event_counts[_event];
+      }
+    }
+  }
+  return 0;
+}
+
 // Pad Class onEvent Function : Modern function for capturing events on a pin
 void Pad::onEvent(uint8_t _event, _pad_callback _callback) {
+  this->_set_event(_event, tweaklyevents::_make_callable(_callback));
+}
+
+// Pad Class onEvent Function : the callback receives _context, so one function can serve many pads
+void Pad::onEvent(uint8_t _event, _pad_context_callback _callback, void *_context) {
+  this->_set_event(_event, tweaklyevents::_make_callable(_callback, _context));
+}
+
+// Pad Class _set_event Function : store the callback of an event
+void Pad::_set_event(uint8_t _event, const tweaklyevents::_callable &_callback) {
   if (_pad_exists){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_number == this->_this_pad_number){
@@ -317,7 +375,7 @@ void Pad::on(bool _inverse = false) {
         } else {
           _this_pad->_pad_status = HIGH; 
         }
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status); 
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status); 
       }
     }
   }
@@ -333,7 +391,7 @@ void Pad::off(bool _inverse = false) {
         } else {
           _this_pad->_pad_status = LOW; 
         }
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status); 
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status); 
       }
     }
   }
@@ -345,7 +403,7 @@ void Pad::lock() {
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_number == this->_this_pad_number && _this_pad->_pad_mode == OUTPUT){
         _this_pad->_pad_locked = LOCK; 
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status); 
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status); 
       }
     }
   }
@@ -357,7 +415,7 @@ void Pad::unlock() {
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_number == this->_this_pad_number && _this_pad->_pad_mode == OUTPUT){
         _this_pad->_pad_locked = UNLOCK;  
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status); 
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status); 
       }
     }
   }
@@ -369,7 +427,7 @@ void Pad::toggle() {
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_number == this->_this_pad_number && _this_pad->_pad_mode == OUTPUT){
         _this_pad->_pad_status = !_this_pad->_pad_status;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -383,7 +441,7 @@ void Pad::write(uint8_t _new_value) {
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_number == this->_this_pad_number && _this_pad->_pad_mode == OUTPUT){
         _this_pad->_pad_status = _new_value;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -447,7 +505,7 @@ void digitalLockAll(){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_mode == OUTPUT){
         _this_pad->_pad_locked = LOCK;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -459,7 +517,7 @@ void digitalUnlockAll(){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_mode == OUTPUT){
         _this_pad->_pad_locked = UNLOCK;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -471,7 +529,7 @@ void digitalToggleAll(){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_mode == OUTPUT && _this_pad->_pad_locked == UNLOCK){
         _this_pad->_pad_status = !_this_pad->_pad_status;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -483,7 +541,7 @@ void digitalToggleClass(const char *_digital_pad_class){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_mode == OUTPUT && strcmp(_this_pad->_pad_class,_digital_pad_class) == 0 && _this_pad->_pad_locked == UNLOCK){
         _this_pad->_pad_status = !_this_pad->_pad_status;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -495,7 +553,7 @@ void digitalWriteAll(uint8_t _digital_status){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_mode == OUTPUT && _this_pad->_pad_status != _digital_status && _this_pad->_pad_locked == UNLOCK){
         _this_pad->_pad_status = _digital_status;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -507,7 +565,7 @@ void digitalWriteClass(const char *_digital_pad_class, uint8_t _digital_status){
     for (_pads *_this_pad = _first_pad; _this_pad != NULL; _this_pad = _this_pad->_next_pad){
       if (_this_pad->_pad_mode == OUTPUT && _this_pad->_pad_status != _digital_status && strcmp(_this_pad->_pad_class,_digital_pad_class) == 0 && _this_pad->_pad_locked == UNLOCK){
         _this_pad->_pad_status = _digital_status;
-        digitalWrite(_this_pad->_pad_number, _this_pad->_pad_status);
+        _pad_write(_this_pad->_pad_number, _this_pad->_pad_status);
       }
     }
   }
@@ -671,6 +729,15 @@ void Loop() {
           if (_this_pad->_pad_mode == INPUT) {
             _this_pad->_pad_status = !_this_pad->_pad_status;
           }
+          // Debounced level : the status has to stay the same for the debounce time
+          if (_this_pad->_pad_status != _this_pad->_pad_level_candidate) {
+            _this_pad->_pad_level_candidate = _this_pad->_pad_status;
+            _this_pad->_pad_level_since = _current_millis;
+          } else if (_this_pad->_pad_status != _this_pad->_pad_debounced_status
+                     && (unsigned long)(_current_millis - _this_pad->_pad_level_since) >= _this_pad->_pad_debounce_delay_millis) {
+            _this_pad->_pad_debounced_status = _this_pad->_pad_status;
+            _pad_levels_serial++;
+          }
           if (_this_pad->_pad_switch_release_button == 0 && _this_pad->_pad_status == 0) {
             _this_pad->_pad_button_act_press = true;
           }
@@ -681,18 +748,18 @@ void Loop() {
             _this_pad->_pad_debounce_previous_millis = _this_pad->_pad_debounce_current_millis;
             _this_pad->_pad_switch_release_button = 1;
             if(_this_pad->_pad_rapid_action_counter == 1 && _current_millis >= _this_pad->_pad_rapid_action_time) {
-              _this_pad->_click_callback_function();
+              _pad_event(_this_pad, CLICK, _this_pad->_click_callback_function);
               _this_pad->_pad_rapid_action_counter = 0;
               _this_pad->_pad_long_action = false;
             }
             if(_this_pad->_pad_rapid_action_counter == 2) {
-              _this_pad->_double_click_callback_function();
+              _pad_event(_this_pad, DOUBLE_CLICK, _this_pad->_double_click_callback_function);
               _this_pad->_pad_rapid_action_counter = 0;
               _this_pad->_pad_long_action = false;
             }
             if(_this_pad->_pad_button_releasing){
               _this_pad->_pad_button_releasing = false;
-              _this_pad->_release_callback_function();
+              _pad_event(_this_pad, RELEASE, _this_pad->_release_callback_function);
             }
           } else {
             _this_pad->_pad_button_press = false;
@@ -700,7 +767,6 @@ void Loop() {
           if ((unsigned long)(_this_pad->_pad_debounce_current_millis - _this_pad->_pad_debounce_previous_millis) >= _this_pad->_pad_debounce_delay_millis 
              && _this_pad->_pad_status == _this_pad->_pad_previous_status){
             _this_pad->_pad_debounce_previous_millis = _this_pad->_pad_debounce_current_millis;
-            _this_pad->_pad_debounced_status = _this_pad->_pad_status;
             if (_this_pad->_pad_switch_release_button == 1){
                _this_pad->_pad_switch_release_button = 0;
                _this_pad->_pad_switch_status = !_this_pad->_pad_switch_status;
@@ -712,7 +778,7 @@ void Loop() {
           }
           if(_this_pad->_pad_long_action && _current_millis >= _this_pad->_pad_rapid_action_time + _this_pad->_pad_long_action_time && _this_pad->_pad_button_releasing == true) {
             _this_pad->_pad_long_action = false;
-            _this_pad->_long_press_callback_function();
+            _pad_event(_this_pad, LONG_PRESS, _this_pad->_long_press_callback_function);
           }
           if(_current_millis > _this_pad->_pad_rapid_action_time) {
             _this_pad->_pad_button_press = true;
@@ -723,14 +789,14 @@ void Loop() {
             if(!_this_pad->_pad_output_to_on) {
               _this_pad->_pad_output_to_on = true;
               _this_pad->_pad_output_to_off = false;
-              _this_pad->_to_on_callback_function();
+              _pad_event(_this_pad, TO_ON, _this_pad->_to_on_callback_function);
             }
           }
           if(_this_pad->_pad_status == LOW) {
             if(!_this_pad->_pad_output_to_off) {
               _this_pad->_pad_output_to_on = false;
               _this_pad->_pad_output_to_off = true;
-              _this_pad->_to_off_callback_function();
+              _pad_event(_this_pad, TO_OFF, _this_pad->_to_off_callback_function);
             }
           }
         }
@@ -779,6 +845,15 @@ void Loop() {
   }
 }
 
+// Idle while there are no pads
+bool _pads_idle() {
+    return !_pad_exists && !_pwm_pad_exists;
+}
+
+#if _TWEAKLY_USES(TWEAKLY_STATIC_PADS + TWEAKLY_STATIC_PWM_PADS)
+tweaklyrun::Module _pads_module("pads", Loop, MODULE_ORDER_PADS, Setup, _pads_idle);
+#endif
+
 }
 
 #endif 
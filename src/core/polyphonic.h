@@ -151,14 +151,17 @@ namespace tweaklypolyphonic {
    };
 
    _players *_first_player = NULL, *_last_player =  NULL;
+   tweaklystorage::_records<_players, TWEAKLY_STATIC_PLAYERS> _players_storage;
    
   // Player Class
   class Player {
     private : 
     unsigned long _this_position = _players_counter++;
     public :
+    template <typename _static_check = void>
     Player() {
-      _players *_new_player = new _players;
+      _TWEAKLY_REQUIRES(TWEAKLY_STATIC_PLAYERS, "a Player needs TWEAKLY_STATIC_PLAYERS in static mode");
+      _players *_new_player = _players_storage.take();
       if (_first_player == NULL){
       _first_player = _new_player;
       }else{
@@ -305,6 +308,7 @@ namespace tweaklypolyphonic {
           if (_this_player->_player_output) {
             if ((unsigned long)(_this_player->_player_current_millis - _this_player->_player_previous_millis) >= _this_player->_player_note_duration) {
                noTone(_this_player->_player_buzzer_pin);
+               TWEAKLY_TRACE_EVENT(TRACE_PLAYER_NOTE, _this_player->_player_buzzer_pin, 0);
                _this_player->_player_previous_millis = _this_player->_player_current_millis;
                _this_player->_player_output = false;
             }
@@ -312,6 +316,7 @@ namespace tweaklypolyphonic {
           if(!_this_player->_player_output) {
             if ((unsigned long)(_this_player->_player_current_millis - _this_player->_player_previous_millis) >= _this_player->_player_notes_delay) {
                tone(_this_player->_player_buzzer_pin, _this_player->_player_melody_notes[_this_player->_player_current_note]);
+               TWEAKLY_TRACE_EVENT(TRACE_PLAYER_NOTE, _this_player->_player_buzzer_pin, _this_player->_player_melody_notes[_this_player->_player_current_note]);
                _this_player->_player_current_note++;
                if (_this_player->_player_current_note >= _this_player->_player_number_of_notes) {
                  _this_player->_player_current_note = 0;
@@ -329,6 +334,15 @@ namespace tweaklypolyphonic {
     }
   }
 
+   // Idle while there are no Players
+   bool _players_idle() {
+     return !_player_exists;
+   }
+
+   #if _TWEAKLY_USES(TWEAKLY_STATIC_PLAYERS)
+   tweaklyrun::Module _players_module("players", Loop, MODULE_ORDER_PLAYERS, Setup, _players_idle);
+   #endif
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,266 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * RUN MODULE FOR TWEAKLY
+ *
+ * Every module of Tweakly registers a Module with its Setup and Loop, and optionally
+ * a hook telling when it is idle and one telling when it has work again.
+ * TweaklyRun() walks the modules by order and skips the idle and sleeping ones.
+ * A sketch or an app joins the same pass with its own Module :
+ *
+ *   void myLoop() { ... }
+ *   Module myModule("mine", myLoop);
+ *
+ * With #define TWEAKLY_PROFILE before #include "Tweakly.h" every module counts
+ * its runs, the microseconds spent in its Loop and the longest Loop, to find
+ * the module that slows the pass down. Without it nothing is measured.
+ *
+ */
+
+#ifndef RUN_H
+#define RUN_H
+
+namespace tweaklyrun {
+
+    // Order of the modules of Tweakly, lower runs first, modules with the same order run as registered
+    #define MODULE_ORDER_PADS 10
+    #define MODULE_ORDER_TIMERS 20
+    #define MODULE_ORDER_PLAYERS 30
+    #define MODULE_ORDER_CLOCK 40
+    #define MODULE_ORDER_SONAR 50
+    #define MODULE_ORDER_ENCODER 60
+    #define MODULE_ORDER_EVENTS 70
+    #define MODULE_ORDER_STATEMENTS 80
+    #define MODULE_ORDER_APPS 90
+
+    // Type definition
+    typedef void (*_module_hook)();
+    typedef bool (*_module_idle_hook)();              // -> true when Loop has nothing to do
+    typedef unsigned long (*_module_deadline_hook)(); // -> millis at which Loop has work again
+
+    class Module;
+    Module *_first_module = NULL;
+
+    class Module {
+      private :
+      const char *           _module_name;
+      _module_hook           _module_setup;
+      _module_hook           _module_loop;
+      _module_idle_hook      _module_idle;
+      _module_deadline_hook  _module_deadline;
+      uint8_t                _module_order;
+      bool                   _module_ready;
+      #if defined(TWEAKLY_PROFILE)
+      unsigned long          _module_runs;
+      unsigned long          _module_micros;
+      unsigned long          _module_max_micros;
+      #endif
+      Module *               _next_module;
+      void _insert();
+      void _remove();
+      friend void Loop();
+      friend Module *getModule(const char *_name);
+      friend void profileReset();
+      friend void profileDump(Print *_stream);
+      public :
+      Module(const char *_name, _module_hook _loop, uint8_t _order = MODULE_ORDER_APPS, _module_hook _setup = NULL, _module_idle_hook _idle = NULL, _module_deadline_hook _deadline = NULL) {
+        _module_name = _name;
+        _module_setup = _setup;
+        _module_loop = _loop;
+        _module_idle = _idle;
+        _module_deadline = _deadline;
+        _module_order = _order;
+        _module_ready = false;
+        #if defined(TWEAKLY_PROFILE)
+        _module_runs = 0;
+        _module_micros = 0;
+        _module_max_micros = 0;
+        #endif
+        _next_module = NULL;
+        _insert();
+      }
+      const char *name();
+      void order(uint8_t _order);
+      uint8_t order();
+      void idleWhen(_module_idle_hook _idle);
+      void wakeAt(_module_deadline_hook _deadline);
+      unsigned long runs();
+      unsigned long totalMicros();
+      unsigned long maxMicros();
+    };
+
+    // Module Class _insert Function : keep the list sorted by order
+    void Module::_insert() {
+      if (_first_module == NULL || _first_module->_module_order > this->_module_order){
+        this->_next_module = _first_module;
+        _first_module = this;
+        return;
+      }
+      Module *_previous = _first_module;
+      while (_previous->_next_module != NULL && _previous->_next_module->_module_order <= this->_module_order){
+        _previous = _previous->_next_module;
+      }
+      this->_next_module = _previous->_next_module;
+      _previous->_next_module = this;
+    }
+
+    void Module::_remove() {
+      if (_first_module == this){
+        _first_module = this->_next_module;
+        return;
+      }
+      for (Module *_previous = _first_module; _previous != NULL; _previous = _previous->_next_module){
+        if (_previous->_next_module == this){
+          _previous->_next_module = this->_next_module;
+          return;
+        }
+      }
+    }
+
+    // Module Class name Function
+    const char *Module::name() {
+      return this->_module_name;
+    }
+
+    // Module Class order Function : move the module in the pass, call it from setup()
+    void Module::order(uint8_t _order) {
+      _remove();
+      this->_module_order = _order;
+      this->_next_module = NULL;
+      _insert();
+    }
+
+    uint8_t Module::order() {
+      return this->_module_order;
+    }
+
+    // Module Class idleWhen Function : Loop is skipped while the hook returns true
+    void Module::idleWhen(_module_idle_hook _idle) {
+      this->_module_idle = _idle;
+    }
+
+    // Module Class wakeAt Function : Loop is skipped until the millis returned by the hook
+    void Module::wakeAt(_module_deadline_hook _deadline) {
+      this->_module_deadline = _deadline;
+    }
+
+    // Module Class runs Function : passes in which Loop was called, with TWEAKLY_PROFILE
+    unsigned long Module::runs() {
+      #if defined(TWEAKLY_PROFILE)
+      return this->_module_runs;
+      #else
+      return 0;
+      #endif
+    }
+
+    // Module Class totalMicros Function : time spent in Loop, with TWEAKLY_PROFILE
+    unsigned long Module::totalMicros() {
+      #if defined(TWEAKLY_PROFILE)
+      return this->_module_micros;
+      #else
+      return 0;
+      #endif
+    }
+
+    // Module Class maxMicros Function : longest Loop, with TWEAKLY_PROFILE
+    unsigned long Module::maxMicros() {
+      #if defined(TWEAKLY_PROFILE)
+      return this->_module_max_micros;
+      #else
+      return 0;
+      #endif
+    }
+
+    // getModule : the module with this name, NULL when there is none
+    Module *getModule(const char *_name) {
+      for (Module *_this_module = _first_module; _this_module != NULL; _this_module = _this_module->_next_module){
+        if (strcmp(_this_module->name(), _name) == 0){
+          return _this_module;
+        }
+      }
+      return NULL;
+    }
+
+    // profileReset : forget the runs and times of every module
+    void profileReset() {
+      #if defined(TWEAKLY_PROFILE)
+      for (Module *_this_module = _first_module; _this_module != NULL; _this_module = _this_module->_next_module){
+        _this_module->_module_runs = 0;
+        _this_module->_module_micros = 0;
+        _this_module->_module_max_micros = 0;
+      }
+      #endif
+    }
+
+    // profileDump : print every module, in the order of the pass, as "name runs total_us max_us" lines
+    void profileDump(Print *_stream) {
+      #if defined(TWEAKLY_PROFILE)
+      if (_stream == NULL){
+        return;
+      }
+      for (Module *_this_module = _first_module; _this_module != NULL; _this_module = _this_module->_next_module){
+        _stream->print(_this_module->_module_name);
+        _stream->print(' ');
+        _stream->print(_this_module->_module_runs);
+        _stream->print(' ');
+        _stream->print(_this_module->_module_micros);
+        _stream->print(' ');
+        _stream->println(_this_module->_module_max_micros);
+      }
+      #else
+      (void)_stream;
+      #endif
+    }
+
+    // Loop for all modules : a module runs its Setup in the first pass after it registered, its Loop in the next ones
+    void Loop() {
+      for (Module *_this_module = _first_module; _this_module != NULL; _this_module = _this_module->_next_module){
+        if (!_this_module->_module_ready){
+          if (_this_module->_module_setup != NULL){
+            _this_module->_module_setup();
+          }
+          _this_module->_module_ready = true;
+          continue;
+        }
+        if (_this_module->_module_idle != NULL && _this_module->_module_idle()){
+          continue;
+        }
+        if (_this_module->_module_deadline != NULL && (long)(millis() - _this_module->_module_deadline()) < 0){
+          continue;
+        }
+        #if defined(TWEAKLY_PROFILE)
+        unsigned long _start_micros = micros();
+        _this_module->_module_loop();
+        unsigned long _loop_micros = micros() - _start_micros;
+        _this_module->_module_micros += _loop_micros;
+        _this_module->_module_runs++;
+        if (_loop_micros > _this_module->_module_max_micros){
+          _this_module->_module_max_micros = _loop_micros;
+        }
+        #else
+        _this_module->_module_loop();
+        #endif
+      }
+    }
+
+}
+
+#endif
@@ -0,0 +1,126 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * STORAGE MODULE FOR TWEAKLY
+ *
+ * Where the records of pads, timers, players, clocks, sonars, encoders and doList pipeline steps live.
+ * By default every object takes its record from the heap.
+ * Static configuration mode declares, before #include "Tweakly.h", how many objects
+ * of each kind the sketch has :
+ *
+ *   #define TWEAKLY_STATIC
+ *   #define TWEAKLY_STATIC_PADS 3
+ *   #define TWEAKLY_STATIC_TIMERS 2
+ *   #include "Tweakly.h"
+ *
+ * Records then come from flat arrays sized at compile time, and TweaklyRun() only
+ * contains the modules with a count, the others are left out of the build.
+ * A Pad, TickTimer, Player, Clock, sonarAttach or encoderAttach without its count
+ * would never run, so it does not compile. An object beyond its count stops the
+ * sketch with abort(), the counts have to be raised.
+ * A module may also get a count without TWEAKLY_STATIC, to keep its records off the heap.
+ *
+ * Static mode only covers these records : they are still linked in lists, TweaklyRun()
+ * still walks the modules it registers, and clock alarms, Echo buffers, the ESP32 PWM
+ * and Arduino Due tone pads and the pipeline steps without a count come from the heap.
+ *
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#if defined(TWEAKLY_STATIC)
+  #define _TWEAKLY_STATIC_MODE 1
+#else
+  #define _TWEAKLY_STATIC_MODE 0
+#endif
+
+// Objects of each kind in the sketch, 0 takes them from the heap
+#ifndef TWEAKLY_STATIC_PADS
+  #define TWEAKLY_STATIC_PADS 0
+#endif
+#ifndef TWEAKLY_STATIC_PWM_PADS
+  #define TWEAKLY_STATIC_PWM_PADS 0
+#endif
+#ifndef TWEAKLY_STATIC_TIMERS
+  #define TWEAKLY_STATIC_TIMERS 0
+#endif
+#ifndef TWEAKLY_STATIC_PLAYERS
+  #define TWEAKLY_STATIC_PLAYERS 0
+#endif
+#ifndef TWEAKLY_STATIC_CLOCKS
+  #define TWEAKLY_STATIC_CLOCKS 0
+#endif
+#ifndef TWEAKLY_STATIC_SONARS
+  #define TWEAKLY_STATIC_SONARS 0
+#endif
+#ifndef TWEAKLY_STATIC_ENCODERS
+  #define TWEAKLY_STATIC_ENCODERS 0
+#endif
+#ifndef TWEAKLY_STATIC_PIPELINES
+  #define TWEAKLY_STATIC_PIPELINES 0
+#endif
+
+// True when TweaklyRun() has to run a module with _count objects
+#define _TWEAKLY_USES(_count) (!_TWEAKLY_STATIC_MODE || (_count) > 0)
+
+// Check of a constructor or attach function declared with template <typename _static_check = void> :
+// it is compiled only where the sketch creates the object, so only those sketches fail on a missing count
+#define _TWEAKLY_REQUIRES(_count, _message) static_assert(_TWEAKLY_USES(_count) || sizeof(_static_check *) == 0, _message)
+
+namespace tweaklystorage {
+
+    // Records of a module : _size from a static array, one more is a hard failure rather than a hidden heap record
+    template <typename _record, size_t _size>
+    class _records {
+      private :
+      _record _storage[_size];
+      size_t  _used;
+      public :
+      _records() : _used(0) { }
+      _record *take() {
+        if (_used < _size){
+          _record *_new_record = &_storage[_used++];
+          *_new_record = _record();
+          return _new_record;
+        }
+        abort();
+      }
+      size_t used() {
+        return _used;
+      }
+    };
+
+    // Records of a kind without a count : from the heap
+    template <typename _record>
+    class _records<_record, 0> {
+      public :
+      _record *take() {
+        return new _record;
+      }
+      size_t used() {
+        return 0;
+      }
+    };
+
+}
+
+#endif
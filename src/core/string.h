@@ -34,16 +34,350 @@
 
 namespace tweaklystring {
     
+    
+    // Size of the chunks written to a Stream and of the buffer behind stringAssembler's String
+    #define TWEAKLY_FORMAT_CHUNK 32
+    #define TWEAKLY_STRING_ASSEMBLER_SIZE 200
+
+    // Argument types known by the formatter
+    #define FORMAT_SIGNED 0
+    #define FORMAT_UNSIGNED 1
+    #define FORMAT_DOUBLE 2
+    #define FORMAT_CHAR 3
+    #define FORMAT_STRING 4
+    #define FORMAT_FLASH_STRING 5
+
+    // Widest integer the formatter writes : long long where the core printf has it, long on AVR
+    #if defined(__AVR__)
+      typedef long _format_long;
+      typedef unsigned long _format_ulong;
+    #else
+      typedef long long _format_long;
+      typedef unsigned long long _format_ulong;
+    #endif
+
+    // Struct for a typed formatter argument, the directive only chooses how it is written
+    struct _format_arg {
+      uint8_t _type;
+      uint8_t _size;                      // -> bytes of a signed argument, %u %x %o %b write only these bits
+      union {
+        _format_long  _signed;
+        _format_ulong _unsigned;
+        double        _double;
+        char          _char;
+        const char *  _string;
+      };
+    };
+
+    inline _format_arg _make_format_signed(_format_long _value, uint8_t _size) { _format_arg _arg; _arg._type = FORMAT_SIGNED; _arg._size = _size; _arg._signed = _value; return _arg; }
+    inline _format_arg _make_format_arg(long long _value) { return _make_format_signed(_value, sizeof(long long)); }
+    inline _format_arg _make_format_arg(long _value) { return _make_format_signed(_value, sizeof(long)); }
+    inline _format_arg _make_format_arg(int _value) { return _make_format_signed(_value, sizeof(int)); }
+    inline _format_arg _make_format_arg(short _value) { return _make_format_signed(_value, sizeof(short)); }
+    inline _format_arg _make_format_arg(signed char _value) { return _make_format_signed(_value, sizeof(signed char)); }
+    inline _format_arg _make_format_arg(unsigned long long _value) { _format_arg _arg; _arg._type = FORMAT_UNSIGNED; _arg._unsigned = _value; return _arg; }
+    inline _format_arg _make_format_arg(unsigned long _value) { _format_arg _arg; _arg._type = FORMAT_UNSIGNED; _arg._unsigned = _value; return _arg; }
+    inline _format_arg _make_format_arg(unsigned int _value) { return _make_format_arg((unsigned long)_value); }
+    inline _format_arg _make_format_arg(unsigned short _value) { return _make_format_arg((unsigned long)_value); }
+    inline _format_arg _make_format_arg(unsigned char _value) { return _make_format_arg((unsigned long)_value); }
+    inline _format_arg _make_format_arg(bool _value) { return _make_format_arg((unsigned long)_value); }
+    inline _format_arg _make_format_arg(double _value) { _format_arg _arg; _arg._type = FORMAT_DOUBLE; _arg._double = _value; return _arg; }
+    inline _format_arg _make_format_arg(float _value) { return _make_format_arg((double)_value); }
+    inline _format_arg _make_format_arg(char _value) { _format_arg _arg; _arg._type = FORMAT_CHAR; _arg._char = _value; return _arg; }
+    inline _format_arg _make_format_arg(const char *_value) { _format_arg _arg; _arg._type = FORMAT_STRING; _arg._string = _value; return _arg; }
+    inline _format_arg _make_format_arg(const void *_value) { return _make_format_arg((unsigned long)(uintptr_t)_value); }
+    inline _format_arg _make_format_arg(const String &_value) { return _make_format_arg(_value.c_str()); }
+    inline _format_arg _make_format_arg(const __FlashStringHelper *_value) { _format_arg _arg; _arg._type = FORMAT_FLASH_STRING; _arg._string = (const char *)_value; return _arg; }
+
+    // Formatter output: chunks to a Print object, or a bounded copy into a caller buffer
+    class _format_sink {
+      private :
+      Print *  _stream;
+      char *   _buffer;
+      size_t   _size;
+      size_t   _length;
+      char     _chunk[TWEAKLY_FORMAT_CHUNK];
+      uint8_t  _chunk_length;
+      public :
+      _format_sink(Print *_new_stream) : _stream(_new_stream), _buffer(NULL), _size(0), _length(0), _chunk_length(0) {}
+      _format_sink(char *_new_buffer, size_t _new_size) : _stream(NULL), _buffer(_new_buffer), _size(_new_size), _length(0), _chunk_length(0) {}
+      void put(char _c) {
+        if (_stream != NULL){
+          _chunk[_chunk_length++] = _c;
+          if (_chunk_length == TWEAKLY_FORMAT_CHUNK){
+            flush();
+          }
+        } else if (_length + 1 < _size){
+          _buffer[_length] = _c;
+        }
+        _length++;
+      }
+      void repeat(char _c, int _count) {
+        while (_count-- > 0){
+          put(_c);
+        }
+      }
+      void flush() {
+        if (_stream != NULL){
+          if (_chunk_length > 0){
+            _stream->write((const uint8_t *)_chunk, _chunk_length);
+            _chunk_length = 0;
+          }
+        } else if (_size > 0){
+          _buffer[_length < _size ? _length : _size - 1] = '\0';
+        }
+      }
+      size_t length() {
+        return _length;
+      }
+    };
+
+    // Write a sign and a text with the padding of a directive
+    void _format_padded(_format_sink &_sink, char _prefix, const char *_text, int _length, int _width, bool _left, char _pad) {
+      int _padding = _width - _length - (_prefix != 0 ? 1 : 0);
+      if (!_left && _pad == ' '){
+        _sink.repeat(' ', _padding);
+      }
+      if (_prefix != 0){
+        _sink.put(_prefix);
+      }
+      if (!_left && _pad == '0'){
+        _sink.repeat('0', _padding);
+      }
+      for (int i = 0; i < _length; i++){
+        _sink.put(_text[i]);
+      }
+      if (_left){
+        _sink.repeat(' ', _padding);
+      }
+    }
+
+    inline char _format_digit(uint8_t _digit, bool _upper) {
+      return _digit < 10 ? '0' + _digit : (_upper ? 'A' : 'a') + _digit - 10;
+    }
+
+    // Digits of an unsigned number, written from the end of _text; returns the first digit
+    char *_format_digits(char *_end, _format_ulong _value, uint8_t _base, bool _upper, uint8_t _min_digits) {
+      char *_text = _end;
+      // Wide divisions only for the digits above unsigned long
+      while (_value != (unsigned long)_value){
+        *--_text = _format_digit(_value % _base, _upper);
+        _value /= _base;
+      }
+      unsigned long _narrow = _value;
+      do {
+        *--_text = _format_digit(_narrow % _base, _upper);
+        _narrow /= _base;
+      } while (_narrow != 0 || _end - _text < _min_digits);
+      return _text;
+    }
+
+    // Write an unsigned number with the padding of a directive
+    void _format_number(_format_sink &_sink, _format_ulong _value, bool _negative, uint8_t _base, bool _upper, int _width, bool _left, char _pad, char _sign) {
+      char _digits[sizeof(_format_ulong) * 8 + 1];
+      char *_text = _format_digits(_digits + sizeof(_digits), _value, _base, _upper, 1);
+      _format_padded(_sink, _negative ? '-' : _sign, _text, _digits + sizeof(_digits) - _text, _width, _left, _pad);
+    }
+
+    // Write a double in fixed notation (up to 9 decimals)
+    void _format_double(_format_sink &_sink, double _value, int _precision, int _width, bool _left, char _pad, char _sign) {
+      if (_value != _value){
+        _format_padded(_sink, 0, "nan", 3, _width, _left, ' ');
+        return;
+      }
+      bool _negative = _value < 0;
+      if (_negative){
+        _value = -_value;
+      }
+      if (_value > 4294967295.0){
+        _format_padded(_sink, _negative ? '-' : _sign, "ovf", 3, _width, _left, ' ');
+        return;
+      }
+      if (_precision > 9){
+        _precision = 9;
+      }
+      unsigned long _scale = 1;
+      for (int i = 0; i < _precision; i++){
+        _scale *= 10;
+      }
+      unsigned long _integer = (unsigned long)_value;
+      unsigned long _fraction = (unsigned long)((_value - (double)_integer) * _scale + 0.5);
+      if (_fraction >= _scale){
+        _fraction -= _scale;
+        _integer++;
+      }
+      char _digits[21];
+      char *_end = _digits + sizeof(_digits);
+      char *_text = _end;
+      if (_precision > 0){
+        _text = _format_digits(_end, _fraction, 10, false, _precision);
+        *--_text = '.';
+      }
+      _text = _format_digits(_text, _integer, 10, false, 1);
+      _format_padded(_sink, _negative ? '-' : _sign, _text, _end - _text, _width, _left, _pad);
+    }
+
+    // Write a single character with the padding of a directive
+    void _format_char(_format_sink &_sink, char _c, int _width, bool _left) {
+      if (!_left) { _sink.repeat(' ', _width - 1); }
+      _sink.put(_c);
+      if (_left) { _sink.repeat(' ', _width - 1); }
+    }
+
+    // Write a string (RAM or flash) with the padding of a directive
+    void _format_string(_format_sink &_sink, const char *_string, bool _flash, int _precision, int _width, bool _left) {
+      if (_string == NULL){
+        _string = "(null)";
+        _flash = false;
+      }
+      int _length = 0;
+      while ((_precision < 0 || _length < _precision) && (_flash ? pgm_read_byte(_string + _length) : _string[_length]) != '\0'){
+        _length++;
+      }
+      if (!_left){
+        _sink.repeat(' ', _width - _length);
+      }
+      for (int i = 0; i < _length; i++){
+        _sink.put(_flash ? pgm_read_byte(_string + i) : _string[i]);
+      }
+      if (_left){
+        _sink.repeat(' ', _width - _length);
+      }
+    }
+
+    // Formatter: printf-like directives (%d %i %u %ld %lld %x %X %o %b %p %c %s %f %%, flags - 0 + space, width, precision)
+    // applied to typed arguments, so a wrong directive can never read past the arguments or the output
+    size_t _format(_format_sink &_sink, const char *_phrase, const _format_arg *_args, uint8_t _args_count) {
+      uint8_t _arg_index = 0;
+      while (*_phrase != '\0'){
+        if (*_phrase != '%'){
+          _sink.put(*_phrase++);
+          continue;
+        }
+        const char *_directive = _phrase++;
+        if (*_phrase == '%'){
+          _sink.put(*_phrase++);
+          continue;
+        }
+        bool _left = false;
+        char _pad = ' ';
+        char _sign = 0;
+        for (;; _phrase++){
+          if (*_phrase == '-') { _left = true; }
+          else if (*_phrase == '0') { _pad = '0'; }
+          else if (*_phrase == '+') { _sign = '+'; }
+          else if (*_phrase == ' ') { if (_sign == 0) { _sign = ' '; } }
+          else { break; }
+        }
+        int _width = 0;
+        while (*_phrase >= '0' && *_phrase <= '9'){
+          _width = _width * 10 + *_phrase++ - '0';
+        }
+        int _precision = -1;
+        if (*_phrase == '.'){
+          _phrase++;
+          _precision = 0;
+          while (*_phrase >= '0' && *_phrase <= '9'){
+            _precision = _precision * 10 + *_phrase++ - '0';
+          }
+        }
+        // Length modifiers are skipped, the argument already knows its size
+        while (*_phrase == 'l' || *_phrase == 'h' || *_phrase == 'z'){
+          _phrase++;
+        }
+        char _conversion = *_phrase;
+        if (_conversion == '\0' || _arg_index >= _args_count){
+          // Incomplete directive or missing argument: the directive is written as it is
+          while (_directive != _phrase && *_directive != '\0'){
+            _sink.put(*_directive++);
+          }
+          if (_conversion != '\0'){
+            _sink.put(*_phrase++);
+          }
+          continue;
+        }
+        _phrase++;
+        const _format_arg *_arg = &_args[_arg_index++];
+        uint8_t _base = 10;
+        switch (_conversion){
+          case 'x' : case 'X' : case 'p' : _base = 16; break;
+          case 'o' : _base = 8; break;
+          case 'b' : _base = 2; break;
+        }
+        switch (_arg->_type){
+          case FORMAT_SIGNED :
+            if (_conversion == 'c'){
+              _format_char(_sink, (char)_arg->_signed, _width, _left);
+            } else if (_base == 10 && _conversion != 'u'){
+              bool _negative = _arg->_signed < 0;
+              _format_number(_sink, _negative ? 0 - (_format_ulong)_arg->_signed : (_format_ulong)_arg->_signed, _negative, 10, false, _width, _left, _pad, _sign);
+            } else {
+              // %u %x %o %b of a negative value: the bits of the argument type, as printf does
+              _format_ulong _bits = (_format_ulong)_arg->_signed;
+              if (_arg->_size < sizeof(_format_ulong)){
+                _bits &= ((_format_ulong)1 << (_arg->_size * 8)) - 1;
+              }
+              _format_number(_sink, _bits, false, _base, _conversion == 'X', _width, _left, _pad, 0);
+            }
+          break;
+          case FORMAT_UNSIGNED :
+            if (_conversion == 'c'){
+              _format_char(_sink, (char)_arg->_unsigned, _width, _left);
+            } else if (_conversion == 'p'){
+              char _digits[sizeof(_format_ulong) * 2 + 2];
+              char *_text = _format_digits(_digits + sizeof(_digits), _arg->_unsigned, 16, false, 1);
+              *--_text = 'x';
+              *--_text = '0';
+              _format_padded(_sink, 0, _text, _digits + sizeof(_digits) - _text, _width, _left, ' ');
+            } else {
+              _format_number(_sink, _arg->_unsigned, false, _base, _conversion == 'X', _width, _left, _pad, _base == 10 ? _sign : 0);
+            }
+          break;
+          case FORMAT_DOUBLE :
+            _format_double(_sink, _arg->_double, _precision < 0 ? 6 : _precision, _width, _left, _pad, _sign);
+          break;
+          case FORMAT_CHAR :
+            if (_conversion == 'c' || _conversion == 's'){
+              _format_char(_sink, _arg->_char, _width, _left);
+            } else {
+              _format_number(_sink, (unsigned char)_arg->_char, false, _base, _conversion == 'X', _width, _left, _pad, 0);
+            }
+          break;
+          case FORMAT_STRING :
+          case FORMAT_FLASH_STRING :
+            _format_string(_sink, _arg->_string, _arg->_type == FORMAT_FLASH_STRING, _precision, _width, _left);
+          break;
+        }
+      }
+      _sink.flush();
+      return _sink.length();
+    }
+
+    // Format typed arguments into a caller buffer, never allocates and never writes more than _size bytes;
+    // returns the length of the complete text, like snprintf
+    template <typename... _assembler_args>
+    size_t stringAssemblerTo(char *_buffer, size_t _size, const char *_phrase, const _assembler_args&... _arguments) {
+      _format_arg _args[] = { _make_format_arg(_arguments)..., _format_arg() };
+      _format_sink _sink(_buffer, _size);
+      return _format(_sink, _phrase, _args, sizeof...(_arguments));
+    }
+
+    // Format typed arguments straight into a Stream, in TWEAKLY_FORMAT_CHUNK bytes chunks
+    template <typename... _assembler_args>
+    size_t streamAssembler(Print *_stream, const char *_phrase, const _assembler_args&... _arguments) {
+      _format_arg _args[] = { _make_format_arg(_arguments)..., _format_arg() };
+      _format_sink _sink(_stream);
+      return _format(_sink, _phrase, _args, sizeof...(_arguments));
+    }
+
     //String Assembler Functions : Allows you to assemble multiple strings together
-    String stringAssembler(const char* phrase, ...) {
-      char complete_phrase[200];
-      va_list arguments;
-      va_start(arguments, phrase);
-      vsprintf(complete_phrase, phrase, arguments);
-      va_end(arguments);
+    template <typename... _assembler_args>
+    String stringAssembler(const char* phrase, const _assembler_args&... _arguments) {
+      char complete_phrase[TWEAKLY_STRING_ASSEMBLER_SIZE];
+      stringAssemblerTo(complete_phrase, sizeof(complete_phrase), phrase, _arguments...);
       return String(complete_phrase);
     }
 
 }
 
-#endif
\ No newline at end of file
+#endif
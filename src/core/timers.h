@@ -68,6 +68,7 @@ namespace tweaklyticktimers {
 
    // Type definition
    typedef void (*_tick_callback)();
+   typedef void (*_tick_context_callback)(void *);
 
    // Struct required for ticks
    struct _ticks{
@@ -80,19 +81,31 @@ namespace tweaklyticktimers {
      uint8_t        _tick_mode;
      unsigned long  _tick_start_watch_time;
      unsigned long  _tick_stop_watch_time;
-    _tick_callback _tick_callback_function;
+    tweaklyevents::_callable _tick_callback_function;
+    unsigned int   _tick_dispatches;
     _ticks *       _next_tick = NULL;
    };
 
    _ticks *_first_tick = NULL, *_last_tick =  NULL;
+   tweaklystorage::_records<_ticks, TWEAKLY_STATIC_TIMERS> _ticks_storage;
+
+   // Count a dispatch of a timer, just before its callback
+   inline void _tick_dispatch(_ticks *_this_tick) {
+     TWEAKLY_TRACE_EVENT(TRACE_TIMER_DISPATCH, _this_tick->_tick_position, _this_tick->_tick_delay);
+     _this_tick->_tick_dispatches++;
+     tweaklypads::_tweakly_events_serial++;
+   }
    
   // TickTimer Class
   class TickTimer {
     private : 
     unsigned long _this_position = _ticks_counter++;
+    void _attach(unsigned long _new_delay, const tweaklyevents::_callable &_callback, uint8_t _new_mode);
     public :
+    template <typename _static_check = void>
     TickTimer() {
-      _ticks *_new_tick = new _ticks;
+      _TWEAKLY_REQUIRES(TWEAKLY_STATIC_TIMERS, "a TickTimer needs TWEAKLY_STATIC_TIMERS in static mode");
+      _ticks *_new_tick = _ticks_storage.take();
       if (_first_tick == NULL){
         _first_tick = _new_tick;
       }else{
@@ -103,12 +116,14 @@ namespace tweaklyticktimers {
       _new_tick->_tick_enabled = 1;
       _new_tick->_tick_previous_time = 0;
       _new_tick->_tick_mode = DISPATCH_FOREVER;
+      _new_tick->_tick_dispatches = 0;
       _last_tick = _new_tick;
       if (!_ticks_exists){
         _ticks_exists = true;
       }
     }
     void attach(unsigned long _new_delay, _tick_callback _callback, uint8_t _new_mode);
+    void attach(unsigned long _new_delay, _tick_context_callback _callback, void *_context, uint8_t _new_mode);
     void setPriority(uint8_t _tick_priority);
     void setInterval(unsigned long _tick_interval);
     void dispatchNow();
@@ -118,8 +133,21 @@ namespace tweaklyticktimers {
     void startWatch();
     void stopWatch();
     unsigned long getWatchTime();
+    unsigned int dispatches();
   };
 
+  // Tick Class dispatches Function : how many times the timer called back, to notice new dispatches
+  unsigned int TickTimer::dispatches() {
+    if(_ticks_exists) {
+      for (_ticks *_this_tick = _first_tick; _this_tick != NULL; _this_tick = _this_tick->_next_tick){
+       if (_this_tick->_tick_position == this->_this_position){
+          return _this_tick->_tick_dispatches;
+        }
+      }
+    }
+    return 0;
+  }
+
   // Tick Class startWatch Function : Set the current milliseconds of the timer for the start of the WatchTime
   void TickTimer::startWatch() {
     if(_ticks_exists) {
@@ -157,6 +185,15 @@ namespace tweaklyticktimers {
 
   // Tick Class Attach Function: attach a function to the timer
   void TickTimer::attach(unsigned long _new_delay, _tick_callback _new_callback, uint8_t _new_mode = DISPATCH_FOREVER) {
+    this->_attach(_new_delay, tweaklyevents::_make_callable(_new_callback), _new_mode);
+  }
+
+  // Tick Class Attach Function: attach a function that receives _context, so one function can serve many timers
+  void TickTimer::attach(unsigned long _new_delay, _tick_context_callback _new_callback, void *_context, uint8_t _new_mode = DISPATCH_FOREVER) {
+    this->_attach(_new_delay, tweaklyevents::_make_callable(_new_callback, _context), _new_mode);
+  }
+
+  void TickTimer::_attach(unsigned long _new_delay, const tweaklyevents::_callable &_new_callback, uint8_t _new_mode) {
     if (_ticks_exists){
       for (_ticks *_this_tick = _first_tick; _this_tick != NULL; _this_tick = _this_tick->_next_tick){
         if (_this_tick->_tick_position == this->_this_position){
@@ -207,7 +244,8 @@ namespace tweaklyticktimers {
     if(_ticks_exists) {
       for (_ticks *_this_tick = _first_tick; _this_tick != NULL; _this_tick = _this_tick->_next_tick){
        if (_this_tick->_tick_position == this->_this_position){
-          _this_tick->_tick_callback_function();
+          _tick_dispatch(_this_tick);
+          tweaklyevents::_call_event(_this_tick->_tick_callback_function, EVENT_CALL_VOID, 0);
         }
       }
     } 
@@ -268,7 +306,8 @@ namespace tweaklyticktimers {
           if(_this_tick->_tick_priority == _tweakly_priority_counter) {
             if ((unsigned long)(_this_tick->_tick_current_millis - _this_tick->_tick_previous_time) >= _this_tick->_tick_delay){
               _this_tick->_tick_previous_time = _this_tick->_tick_current_millis;
-              _this_tick->_tick_callback_function();
+              _tick_dispatch(_this_tick);
+              tweaklyevents::_post_event(EVENT_FROM_TIMER, _this_tick->_tick_position, _this_tick->_tick_callback_function, EVENT_CALL_VOID, 0, EVENT_REPLACE);
               if((_this_tick->_tick_mode == DISPATCH_ONCE || _this_tick->_tick_mode == DISPATCH_OFF) && _this_tick->_tick_enabled == 1) {
                 _this_tick->_tick_enabled = 0;
               }
@@ -285,6 +324,15 @@ namespace tweaklyticktimers {
     }
    }
 
+   // Idle while there are no Tick Timers
+   bool _ticks_idle() {
+     return !_ticks_exists;
+   }
+
+   #if _TWEAKLY_USES(TWEAKLY_STATIC_TIMERS)
+   tweaklyrun::Module _ticks_module("timers", Loop, MODULE_ORDER_TIMERS, Setup, _ticks_idle);
+   #endif
+
 }
 
 #endif
@@ -0,0 +1,167 @@
+//----------------------------------------------------------------------------//
+/*
+ *  Copyright (C) 2021  Filo Connesso - filoconnesso.it
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+ //----------------------------------------------------------------------------//
+
+/*
+ * TRACE MODULE FOR TWEAKLY
+ *
+ * Keeps the last TWEAKLY_TRACE_SIZE events of pads, timers, players and sonars
+ * in RAM, to dump them through an Echo when something goes wrong.
+ * Enable it with #define TWEAKLY_TRACE before #include "Tweakly.h",
+ * without it every trace point compiles to nothing.
+ *
+ * On AVR and ESP32 the ring is not cleared by a watchdog or panic reset,
+ * so the events that led to the reset can be dumped from setup().
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+namespace tweaklytrace {
+
+    // Events recorded by Tweakly, user events start from TRACE_USER
+    #define TRACE_PAD_EVENT 1                 // -> a : pad pin, b : CLICK, DOUBLE_CLICK, LONG_PRESS, RELEASE, TO_ON, TO_OFF
+    #define TRACE_TIMER_DISPATCH 2            // -> a : timer position, b : timer interval
+    #define TRACE_PLAYER_NOTE 3               // -> a : buzzer pin, b : note frequency, 0 when it stops
+    #define TRACE_SONAR_VALUE 4               // -> a : echo pin, b : value delivered to the callback
+    #define TRACE_USER 32
+
+    #ifndef TWEAKLY_TRACE_SIZE
+      #define TWEAKLY_TRACE_SIZE 32
+    #endif
+
+    #define TRACE_MAGIC 0x54574B4CUL
+
+    #if defined(TWEAKLY_TRACE)
+
+    // Memory that survives a reset without power loss
+    #if defined(__AVR__)
+      #define TRACE_NOINIT __attribute__((section(".noinit")))
+    #elif defined(ARDUINO_ARCH_ESP32)
+      #define TRACE_NOINIT RTC_NOINIT_ATTR
+    #else
+      #define TRACE_NOINIT
+    #endif
+
+    struct _trace_record {
+      uint32_t  _trace_micros;
+      uint32_t  _trace_a;
+      uint32_t  _trace_b;
+      uint8_t   _trace_id;
+    };
+
+    struct _trace_ring {
+      uint32_t       _trace_magic;
+      uint16_t       _trace_head;
+      uint16_t       _trace_count;
+      _trace_record  _trace_records[TWEAKLY_TRACE_SIZE];
+    };
+
+    TRACE_NOINIT _trace_ring _trace;
+    bool _trace_checked = false;
+    bool _trace_recovered = false;
+    bool _trace_frozen = false;
+
+    // Keep the ring found after a reset when it is consistent, otherwise start empty
+    void _trace_check() {
+      if (!_trace_checked){
+        _trace_checked = true;
+        _trace_recovered = _trace._trace_magic == TRACE_MAGIC && _trace._trace_head < TWEAKLY_TRACE_SIZE && _trace._trace_count <= TWEAKLY_TRACE_SIZE && _trace._trace_count > 0;
+        if (!_trace_recovered){
+          _trace._trace_magic = TRACE_MAGIC;
+          _trace._trace_head = 0;
+          _trace._trace_count = 0;
+        }
+      }
+    }
+
+    // Record an event : a timestamp and two arguments, nothing is formatted until the dump
+    void traceEvent(uint8_t _id, uint32_t _a, uint32_t _b) {
+      _trace_check();
+      if (_trace_frozen){
+        return;
+      }
+      _trace_record *_record = &_trace._trace_records[_trace._trace_head];
+      _record->_trace_micros = micros();
+      _record->_trace_id = _id;
+      _record->_trace_a = _a;
+      _record->_trace_b = _b;
+      _trace._trace_head = _trace._trace_head + 1 < TWEAKLY_TRACE_SIZE ? _trace._trace_head + 1 : 0;
+      if (_trace._trace_count < TWEAKLY_TRACE_SIZE){
+        _trace._trace_count++;
+      }
+    }
+
+    // Stop or restart recording, freeze from a fault handler to keep the events before it
+    void traceFreeze(bool _freeze) {
+      _trace_frozen = _freeze;
+    }
+
+    // Forget all events
+    void traceClear() {
+      _trace_check();
+      _trace._trace_head = 0;
+      _trace._trace_count = 0;
+      _trace_recovered = false;
+    }
+
+    // True when the events in the ring were recorded before the last reset
+    bool traceRecovered() {
+      _trace_check();
+      return _trace_recovered;
+    }
+
+    // Print the events, oldest first, as "micros id a b" lines
+    void traceDump(Print *_stream) {
+      _trace_check();
+      if (_stream == NULL){
+        return;
+      }
+      uint16_t _index = (_trace._trace_head + TWEAKLY_TRACE_SIZE - _trace._trace_count) % TWEAKLY_TRACE_SIZE;
+      for (uint16_t i = 0; i < _trace._trace_count; i++){
+        _trace_record *_record = &_trace._trace_records[_index];
+        _stream->print((unsigned long)_record->_trace_micros);
+        _stream->print(' ');
+        _stream->print((unsigned int)_record->_trace_id);
+        _stream->print(' ');
+        _stream->print((unsigned long)_record->_trace_a);
+        _stream->print(' ');
+        _stream->println((unsigned long)_record->_trace_b);
+        _index = _index + 1 < TWEAKLY_TRACE_SIZE ? _index + 1 : 0;
+      }
+    }
+
+    #define TWEAKLY_TRACE_EVENT(_id, _a, _b) tweaklytrace::traceEvent(_id, _a, _b)
+
+    #else
+
+    inline void traceEvent(uint8_t, uint32_t, uint32_t) { }
+    inline void traceFreeze(bool) { }
+    inline void traceClear() { }
+    inline bool traceRecovered() { return false; }
+    inline void traceDump(Print *) { }
+
+    #define TWEAKLY_TRACE_EVENT(_id, _a, _b) do { } while (0)
+
+    #endif
+
+}
+
+#endif
@@ -32,36 +32,160 @@
 #ifndef ENCODER_H
 #define ENCODER_H
 
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
 namespace encoder {
    
    //Type definition
    typedef void (*_encoder_callback)(bool);
+   typedef void (*_encoder_steps_callback)(int);
+   typedef void (*_encoder_context_callback)(void *, bool);
+   typedef void (*_encoder_context_steps_callback)(void *, int);
+   typedef void (*_encoder_isr)();
 
    // Enablers
    volatile bool _encoder_exists  { false };
    
    //Variables
-   unsigned long _pad_encoder_default_debounce_millis = 1;
+   uint8_t _encoder_default_counts_per_detent = 4;
+
+   // Maximum number of encoders decoded by external interrupts, the others use pin change interrupts or are polled
+   #define TWEAKLY_MAX_ENCODER_INTERRUPTS 4
+
+   // Definitions for encoder backends
+   #define ENCODER_POLLING 0
+   #define ENCODER_INTERRUPT 1
+   #define ENCODER_PCNT 2                  // -> ESP32 hardware pulse counter
+
+   // Without edges for this time the encoder is considered stopped
+   #define ENCODER_STOP_MICROS 100000UL
+
+   // Struct for encoder settings used by steps callbacks
+   struct encoderSettings {
+     unsigned int  accelerationSpeed = 0;     // -> detents per second where acceleration starts (0 disabled)
+     uint8_t       maxMultiplier = 10;        // -> maximum steps for each detent at high speed
+     unsigned long callbackInterval = 20;     // -> minimum milliseconds between two steps callbacks
+   };
+
+   // Quadrature transitions: index is (previous CLK DT << 2) | current CLK DT, invalid or bouncing transitions count 0
+   const int8_t _encoder_transitions[16] = { 0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0 };
 
    // Struct required for encoders
    struct _encoders{
      uint8_t        _encoder_dt_pad;
      uint8_t        _encoder_clk_pad;
-     bool           _encoder_dt_pad_status;
-     bool           _encoder_clk_pad_status;
-     bool           _encoder_clk_pad_previous_status;
-     unsigned long  _encoder_debounce_current_millis;
-     unsigned long  _encoder_debounce_previous_millis;
-     unsigned long  _encoder_debounce_delay_millis;
-     _encoder_callback _encoder_change_callback;
+     uint8_t        _encoder_backend;
+     uint8_t        _encoder_pcnt_unit;
+     volatile uint8_t _encoder_state;
+     volatile long  _encoder_position;
+     long           _encoder_reported_position;
+     uint8_t        _encoder_counts_per_detent;
+     volatile unsigned long _encoder_edge_micros;
+     long           _encoder_velocity_position;
+     unsigned long  _encoder_velocity_micros;
+     long           _encoder_velocity;
+     encoderSettings _encoder_settings;
+     int            _encoder_pending_steps;
+     unsigned long  _encoder_previous_callback_millis;
+     tweaklyevents::_callable _encoder_steps_change_callback;
+     tweaklyevents::_callable _encoder_change_callback;
      _encoders *    _next_encoder = NULL;
    };
 
    _encoders *_first_encoder =    NULL, *_last_encoder =  NULL;
+   tweaklystorage::_records<_encoders, TWEAKLY_STATIC_ENCODERS> _encoders_storage;
+
+   // Encoder served by each interrupt slot
+   _encoders *_encoder_interrupt_slots[TWEAKLY_MAX_ENCODER_INTERRUPTS];
+   uint8_t    _encoder_interrupt_counter = 0;
+
+   // Decode the current CLK and DT levels of an encoder
+   void IRAM_ATTR _encoder_decode(_encoders *_this_encoder) {
+     uint8_t _state = (digitalRead(_this_encoder->_encoder_clk_pad) << 1) | digitalRead(_this_encoder->_encoder_dt_pad);
+     int8_t _count = _encoder_transitions[(_this_encoder->_encoder_state << 2) | _state];
+     if (_count != 0){
+       _this_encoder->_encoder_position += _count;
+       _this_encoder->_encoder_edge_micros = micros();
+     }
+     _this_encoder->_encoder_state = _state;
+   }
+
+   // Interrupt service routine of a slot, called on both edges of CLK and DT
+   template <uint8_t _slot>
+   void IRAM_ATTR _encoder_slot_isr() {
+     _encoder_decode(_encoder_interrupt_slots[_slot]);
+   }
+
+   const _encoder_isr _encoder_slot_isrs[TWEAKLY_MAX_ENCODER_INTERRUPTS] = {
+     _encoder_slot_isr<0>, _encoder_slot_isr<1>, _encoder_slot_isr<2>, _encoder_slot_isr<3>
+   };
+
+#if defined(ARDUINO_PIN_CHANGE)
+   // Pin change interrupt of CLK or DT when they are not both external interrupts (AVR with TWEAKLY_PIN_CHANGE)
+   void _encoder_pin_change(void *_context) {
+     _encoder_decode((_encoders *)_context);
+   }
+#endif
+
+   // Give an encoder a pulse counter unit (ESP32), an interrupt slot if both of its pins support interrupts, else pin change interrupts if enabled
+   // The remaining encoders are polled by TweaklyRun and miss steps that are shorter than a loop
+   void _encoder_attach_interrupt(_encoders *_this_encoder) {
+     _this_encoder->_encoder_backend = ENCODER_POLLING;
+     #if defined(ARDUINO_ARCH_ESP32) && defined(ESP32_PCNT_SUPPORTED)
+     int _unit = esp32::_esp32_pcnt_encoder_attach(_this_encoder->_encoder_clk_pad, _this_encoder->_encoder_dt_pad);
+     if (_unit >= 0){
+       _this_encoder->_encoder_pcnt_unit = _unit;
+       _this_encoder->_encoder_backend = ENCODER_PCNT;
+       return;
+     }
+     #endif
+     int _clk_interrupt = digitalPinToInterrupt(_this_encoder->_encoder_clk_pad);
+     int _dt_interrupt = digitalPinToInterrupt(_this_encoder->_encoder_dt_pad);
+     if (_clk_interrupt != NOT_AN_INTERRUPT && _dt_interrupt != NOT_AN_INTERRUPT && _encoder_interrupt_counter < TWEAKLY_MAX_ENCODER_INTERRUPTS){
+       _encoder_interrupt_slots[_encoder_interrupt_counter] = _this_encoder;
+       attachInterrupt(_clk_interrupt, _encoder_slot_isrs[_encoder_interrupt_counter], CHANGE);
+       attachInterrupt(_dt_interrupt, _encoder_slot_isrs[_encoder_interrupt_counter], CHANGE);
+       _encoder_interrupt_counter++;
+       _this_encoder->_encoder_backend = ENCODER_INTERRUPT;
+     }
+#if defined(ARDUINO_PIN_CHANGE)
+     // Both pins or none, a half attached encoder would be decoded by the loop and the interrupt at once
+     else if (digitalPinToPCICR(_this_encoder->_encoder_clk_pad) != NULL && digitalPinToPCICR(_this_encoder->_encoder_dt_pad) != NULL && arduino_boards::_pin_change_counter + 2 <= TWEAKLY_MAX_PIN_CHANGES){
+       arduino_boards::attachPinChange(_this_encoder->_encoder_clk_pad, _encoder_pin_change, _this_encoder);
+       arduino_boards::attachPinChange(_this_encoder->_encoder_dt_pad, _encoder_pin_change, _this_encoder);
+       _this_encoder->_encoder_backend = ENCODER_INTERRUPT;
+     }
+#endif
+   }
+
+   // Read the position without locks: retry until two reads agree (a long is not atomic on 8 bit boards)
+   long _encoder_read_position(_encoders *_this_encoder) {
+     #if defined(ARDUINO_ARCH_ESP32) && defined(ESP32_PCNT_SUPPORTED)
+     if (_this_encoder->_encoder_backend == ENCODER_PCNT){
+       return esp32::_esp32_pcnt_encoder_position(_this_encoder->_encoder_pcnt_unit);
+     }
+     #endif
+     long _position;
+     do {
+       _position = _this_encoder->_encoder_position;
+     } while (_position != _this_encoder->_encoder_position);
+     return _position;
+   }
+
+   // Read the time of the last counted edge, same retry as the position
+   unsigned long _encoder_read_edge_micros(_encoders *_this_encoder) {
+     unsigned long _edge_micros;
+     do {
+       _edge_micros = _this_encoder->_encoder_edge_micros;
+     } while (_edge_micros != _this_encoder->_encoder_edge_micros);
+     return _edge_micros;
+   }
    
    // encoderAttach: attach an encoder 
-   void encoderAttach(uint8_t _new_encoder_dt_pad, uint8_t _new_encoder_clk_pad, _encoder_callback _new_encoder_change_callback){
-    _encoders *_new_encoder = new _encoders;
+   void _encoder_attach(uint8_t _new_encoder_dt_pad, uint8_t _new_encoder_clk_pad, const tweaklyevents::_callable &_new_encoder_change_callback, const tweaklyevents::_callable &_new_encoder_steps_callback){
+    _encoders *_new_encoder = _encoders_storage.take();
     _new_encoder->_encoder_dt_pad = _new_encoder_dt_pad;
     _new_encoder->_encoder_clk_pad = _new_encoder_clk_pad;
      if (_first_encoder == NULL){
@@ -70,44 +194,199 @@ namespace encoder {
        _last_encoder->_next_encoder = _new_encoder;
      }
      _new_encoder->_encoder_change_callback = _new_encoder_change_callback;
-     _new_encoder->_encoder_debounce_delay_millis = _pad_encoder_default_debounce_millis;
+     _new_encoder->_encoder_steps_change_callback = _new_encoder_steps_callback;
+     _new_encoder->_encoder_counts_per_detent = _encoder_default_counts_per_detent;
+     _new_encoder->_encoder_edge_micros = micros();
+     _new_encoder->_encoder_velocity_position = 0;
+     _new_encoder->_encoder_velocity_micros = _new_encoder->_encoder_edge_micros;
+     _new_encoder->_encoder_velocity = 0;
+     _new_encoder->_encoder_pending_steps = 0;
+     _new_encoder->_encoder_previous_callback_millis = millis();
+     _new_encoder->_encoder_position = 0;
+     _new_encoder->_encoder_reported_position = 0;
+     _new_encoder->_encoder_state = (digitalRead(_new_encoder_clk_pad) << 1) | digitalRead(_new_encoder_dt_pad);
+     _encoder_attach_interrupt(_new_encoder);
      _last_encoder = _new_encoder;
      if (!_encoder_exists){
        _encoder_exists = true;
     }
    }
+
+   template <typename _static_check = void>
+   void encoderAttach(uint8_t _new_encoder_dt_pad, uint8_t _new_encoder_clk_pad, _encoder_callback _new_encoder_change_callback){
+     _TWEAKLY_REQUIRES(TWEAKLY_STATIC_ENCODERS, "encoderAttach needs TWEAKLY_STATIC_ENCODERS in static mode");
+     _encoder_attach(_new_encoder_dt_pad, _new_encoder_clk_pad, tweaklyevents::_make_callable(_new_encoder_change_callback), tweaklyevents::_make_callable((_encoder_steps_callback)NULL));
+   }
+
+   // encoderAttach: attach an encoder whose callback receives the steps done since the previous call
+   template <typename _static_check = void>
+   void encoderAttach(uint8_t _new_encoder_dt_pad, uint8_t _new_encoder_clk_pad, _encoder_steps_callback _new_encoder_steps_callback){
+     _TWEAKLY_REQUIRES(TWEAKLY_STATIC_ENCODERS, "encoderAttach needs TWEAKLY_STATIC_ENCODERS in static mode");
+     _encoder_attach(_new_encoder_dt_pad, _new_encoder_clk_pad, tweaklyevents::_make_callable((_encoder_callback)NULL), tweaklyevents::_make_callable(_new_encoder_steps_callback));
+   }
+
+   // encoderAttach: same as above, the callbacks also receive _context so one function can serve many encoders
+   template <typename _static_check = void>
+   void encoderAttach(uint8_t _new_encoder_dt_pad, uint8_t _new_encoder_clk_pad, _encoder_context_callback _new_encoder_change_callback, void *_context){
+     _TWEAKLY_REQUIRES(TWEAKLY_STATIC_ENCODERS, "encoderAttach needs TWEAKLY_STATIC_ENCODERS in static mode");
+     _encoder_attach(_new_encoder_dt_pad, _new_encoder_clk_pad, tweaklyevents::_make_callable(_new_encoder_change_callback, _context), tweaklyevents::_make_callable((_encoder_steps_callback)NULL));
+   }
+
+   template <typename _static_check = void>
+   void encoderAttach(uint8_t _new_encoder_dt_pad, uint8_t _new_encoder_clk_pad, _encoder_context_steps_callback _new_encoder_steps_callback, void *_context){
+     _TWEAKLY_REQUIRES(TWEAKLY_STATIC_ENCODERS, "encoderAttach needs TWEAKLY_STATIC_ENCODERS in static mode");
+     _encoder_attach(_new_encoder_dt_pad, _new_encoder_clk_pad, tweaklyevents::_make_callable((_encoder_callback)NULL), tweaklyevents::_make_callable(_new_encoder_steps_callback, _context));
+   }
+
+   // encoderAdjust: set acceleration and callback rate of an encoder with a steps callback
+   void encoderAdjust(uint8_t _encoder_clk_pad, encoderSettings _new_settings){
+     if (_encoder_exists){
+       for (_encoders *_this_encoder = _first_encoder; _this_encoder != NULL; _this_encoder = _this_encoder->_next_encoder){
+         if (_this_encoder->_encoder_clk_pad == _encoder_clk_pad){
+           if (_new_settings.maxMultiplier == 0){
+             _new_settings.maxMultiplier = 1;
+           }
+           _this_encoder->_encoder_settings = _new_settings;
+         }
+       }
+     }
+   }
+
+   // encoderVelocity: speed of an encoder in quadrature counts per second, positive when position grows
+   long encoderVelocity(uint8_t _encoder_clk_pad){
+     long _velocity = 0;
+     if (_encoder_exists){
+       for (_encoders *_this_encoder = _first_encoder; _this_encoder != NULL; _this_encoder = _this_encoder->_next_encoder){
+         if (_this_encoder->_encoder_clk_pad == _encoder_clk_pad){
+           _velocity = _this_encoder->_encoder_velocity;
+         }
+       }
+     }
+     return _velocity;
+   }
+
+   // Update the velocity of an encoder from the time between counted edges
+   void _encoder_update_velocity(_encoders *_this_encoder, long _position, unsigned long _current_micros) {
+     if (_position != _this_encoder->_encoder_velocity_position){
+       unsigned long _edge_micros = _encoder_read_edge_micros(_this_encoder);
+       unsigned long _elapsed_micros = _edge_micros - _this_encoder->_encoder_velocity_micros;
+       if (_elapsed_micros > 0){
+         long _counts = _position - _this_encoder->_encoder_velocity_position;
+         if (_elapsed_micros > ENCODER_STOP_MICROS){
+           // First edge after a stop
+           _elapsed_micros = ENCODER_STOP_MICROS;
+         }
+         _this_encoder->_encoder_velocity = (_this_encoder->_encoder_velocity + _counts * (long)(1000000UL / _elapsed_micros)) / 2;
+         _this_encoder->_encoder_velocity_position = _position;
+         _this_encoder->_encoder_velocity_micros = _edge_micros;
+       }
+     } else if ((unsigned long)(_current_micros - _this_encoder->_encoder_velocity_micros) >= ENCODER_STOP_MICROS){
+       _this_encoder->_encoder_velocity = 0;
+     }
+   }
+
+   // Steps for each detent at the current speed of an encoder
+   int _encoder_multiplier(_encoders *_this_encoder) {
+     encoderSettings *_settings = &_this_encoder->_encoder_settings;
+     if (_settings->accelerationSpeed == 0){
+       return 1;
+     }
+     long _speed = _this_encoder->_encoder_velocity < 0 ? -_this_encoder->_encoder_velocity : _this_encoder->_encoder_velocity;
+     long _multiplier = _speed / _this_encoder->_encoder_counts_per_detent / _settings->accelerationSpeed;
+     if (_multiplier < 1){
+       return 1;
+     }
+     if (_multiplier > _settings->maxMultiplier){
+       return _settings->maxMultiplier;
+     }
+     return _multiplier;
+   }
+
+   // encoderPosition: signed position of an encoder in quadrature counts (4 for each full cycle)
+   long encoderPosition(uint8_t _encoder_clk_pad){
+     long _position = 0;
+     if (_encoder_exists){
+       for (_encoders *_this_encoder = _first_encoder; _this_encoder != NULL; _this_encoder = _this_encoder->_next_encoder){
+         if (_this_encoder->_encoder_clk_pad == _encoder_clk_pad){
+           _position = _encoder_read_position(_this_encoder);
+         }
+       }
+     }
+     return _position;
+   }
+
+   // encoderResolution: quadrature counts between two callbacks (4 for encoders with a detent every full cycle)
+   void encoderResolution(uint8_t _encoder_clk_pad, uint8_t _counts_per_detent){
+     if (_encoder_exists && _counts_per_detent > 0){
+       for (_encoders *_this_encoder = _first_encoder; _this_encoder != NULL; _this_encoder = _this_encoder->_next_encoder){
+         if (_this_encoder->_encoder_clk_pad == _encoder_clk_pad){
+           _this_encoder->_encoder_counts_per_detent = _counts_per_detent;
+         }
+       }
+     }
+   }
    
    // Setup for all encoders
    void Setup() {
     if (_encoder_exists){
-      unsigned long _current_millis = millis();
       for (_encoders *_this_encoder = _first_encoder; _this_encoder != NULL; _this_encoder = _this_encoder->_next_encoder){
-        _this_encoder->_encoder_debounce_previous_millis = _current_millis;
-        _this_encoder->_encoder_clk_pad_previous_status = digitalRead(_this_encoder->_encoder_clk_pad);
+        _this_encoder->_encoder_reported_position = _encoder_read_position(_this_encoder);
       }
     }
    }
    
-   // Loop for all encoders
+   // Loop for all encoders: counts come from the interrupts (or a poll for boards without them), callbacks fire once per detent
    void Loop() {
     if (_encoder_exists){
-      unsigned long _current_millis = millis();
       for (_encoders *_this_encoder = _first_encoder; _this_encoder != NULL; _this_encoder = _this_encoder->_next_encoder){
-        _this_encoder->_encoder_debounce_current_millis = _current_millis;
-        if ((unsigned long)(_this_encoder->_encoder_debounce_current_millis - _this_encoder->_encoder_debounce_previous_millis) >= _this_encoder->_encoder_debounce_delay_millis){
-          _this_encoder->_encoder_clk_pad_status = digitalRead(_this_encoder->_encoder_clk_pad);
-          _this_encoder->_encoder_debounce_previous_millis = _this_encoder->_encoder_debounce_current_millis;
-          if (_this_encoder->_encoder_clk_pad_status != _this_encoder->_encoder_clk_pad_previous_status && _this_encoder->_encoder_clk_pad_status == HIGH){
-            _this_encoder->_encoder_dt_pad_status = digitalRead(_this_encoder->_encoder_dt_pad);
-            _this_encoder->_encoder_change_callback(_this_encoder->_encoder_dt_pad_status);
+        if (_this_encoder->_encoder_backend == ENCODER_POLLING){
+          _encoder_decode(_this_encoder);
+        }
+        long _position = _encoder_read_position(_this_encoder);
+        if (_this_encoder->_encoder_backend == ENCODER_PCNT && _position != _this_encoder->_encoder_velocity_position){
+          // The pulse counter has no edge timestamps, the edges are dated when Loop() sees them
+          _this_encoder->_encoder_edge_micros = micros();
+        }
+        _encoder_update_velocity(_this_encoder, _position, micros());
+        if (_this_encoder->_encoder_steps_change_callback._function == NULL){
+          while (_position - _this_encoder->_encoder_reported_position >= _this_encoder->_encoder_counts_per_detent){
+            _this_encoder->_encoder_reported_position += _this_encoder->_encoder_counts_per_detent;
+            tweaklyevents::_post_event(EVENT_FROM_ENCODER, _this_encoder->_encoder_clk_pad, _this_encoder->_encoder_change_callback, EVENT_CALL_BOOL, true, EVENT_KEEP_ALL);
+          }
+          while (_this_encoder->_encoder_reported_position - _position >= _this_encoder->_encoder_counts_per_detent){
+            _this_encoder->_encoder_reported_position -= _this_encoder->_encoder_counts_per_detent;
+            tweaklyevents::_post_event(EVENT_FROM_ENCODER, _this_encoder->_encoder_clk_pad, _this_encoder->_encoder_change_callback, EVENT_CALL_BOOL, false, EVENT_KEEP_ALL);
+          }
+        } else {
+          // Steps callback: detents are accelerated and batched
+          long _detents = (_position - _this_encoder->_encoder_reported_position) / _this_encoder->_encoder_counts_per_detent;
+          if (_detents != 0){
+            _this_encoder->_encoder_reported_position += _detents * _this_encoder->_encoder_counts_per_detent;
+            _this_encoder->_encoder_pending_steps += _detents * _encoder_multiplier(_this_encoder);
+          }
+          unsigned long _current_millis = millis();
+          if (_this_encoder->_encoder_pending_steps != 0 &&
+              (unsigned long)(_current_millis - _this_encoder->_encoder_previous_callback_millis) >= _this_encoder->_encoder_settings.callbackInterval){
+            int _steps = _this_encoder->_encoder_pending_steps;
+            _this_encoder->_encoder_pending_steps = 0;
+            _this_encoder->_encoder_previous_callback_millis = _current_millis;
+            tweaklyevents::_post_event(EVENT_FROM_ENCODER, _this_encoder->_encoder_clk_pad, _this_encoder->_encoder_steps_change_callback, EVENT_CALL_INT, _steps, EVENT_ADD);
           }
-          _this_encoder->_encoder_clk_pad_previous_status = _this_encoder->_encoder_clk_pad_status;
         }
       }
     }
    }
 
 
+   // Idle while there are no encoders
+   bool _encoders_idle() {
+     return !_encoder_exists;
+   }
+
+   #if _TWEAKLY_USES(TWEAKLY_STATIC_ENCODERS)
+   tweaklyrun::Module _encoders_module("encoder", Loop, MODULE_ORDER_ENCODER, Setup, _encoders_idle);
+   #endif
+
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -32,6 +32,10 @@
 #ifndef SONAR_H
 #define SONAR_H
 
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
 namespace sonar {
     
     // Definitions for sonar
@@ -40,31 +44,211 @@ namespace sonar {
     #define SONAR_CENTIMETERS 2
     #define SONAR_INCHES 3
 
+    // Maximum number of sonar measured by external interrupts, the others use pin change interrupts or are polled
+    #define TWEAKLY_MAX_SONAR_INTERRUPTS 4
+
+    // Definitions for sonar progress status
+    #define SONAR_IDLE 0                      // -> waiting for the turn of its group
+    #define SONAR_START 1
+    #define SONAR_TRIGGER 2
+    #define SONAR_WAIT_ECHO 3
+    #define SONAR_ECHO 4
+    #define SONAR_ECHO_DONE 5
+
+    // Default silence between two groups, lets the echoes of the previous group die out
+    #define SONAR_DEFAULT_QUIET_MICROS 10000UL
+
+    // Definitions for sonar filters
+    #define SONAR_MAX_MEDIAN_SAMPLES 9
+    #define SONAR_FILTER_FRACTION_BITS 8
+    #define SONAR_MAX_SMOOTHING (sizeof(long) * 8 - 1 - SONAR_FILTER_FRACTION_BITS)
+
     // Type definition 
     typedef void (*_sonar_callback)(unsigned long);
+    typedef void (*_sonar_context_callback)(void *, unsigned long);
+    typedef void (*_sonar_isr)();
     
     // Enablers 
     volatile bool _sonar_exists  { false };
 
+    // Struct for sonar filter settings, the defaults send every measure unfiltered
+    struct sonarSettings {
+      unsigned long maxJump = 0;             // -> reject echoes farther than this (microseconds) from the last accepted one, 0 disabled
+      uint8_t       maxRejected = 3;         // -> consecutive rejected echoes before a jump is accepted as real
+      uint8_t       medianSamples = 1;       // -> running median window (1 disabled, up to SONAR_MAX_MEDIAN_SAMPLES)
+      uint8_t       smoothing = 0;           // -> exponential smoothing, new value weighs 1 / 2^smoothing (0 disabled, at most SONAR_MAX_SMOOTHING)
+      unsigned long threshold = 0;           // -> minimum change, in the return mode units, that fires the callback
+    };
+
+    // Scheduler: one group of sonar is triggered at a time, round robin
+    uint8_t       _sonar_groups_counter = 0;
+    uint8_t       _sonar_active_group = 0;
+    bool          _sonar_group_running = false;
+    unsigned long _sonar_quiet_micros = SONAR_DEFAULT_QUIET_MICROS;
+    unsigned long _sonar_quiet_previous_micros = 0;
+
     // Struct required for sonar
     struct _sonars{
       uint8_t         _sonar_echo_pin;
       uint8_t         _sonar_trigger_pin;
-      uint8_t         _sonar_progress_status;
+      volatile uint8_t _sonar_progress_status;
+      bool            _sonar_interrupt;
+      bool            _sonar_echo_previous_status;
       unsigned long   _sonar_current_micros;
       unsigned long   _sonar_previous_micros;
       unsigned long   _sonar_delay_micros;
+      volatile unsigned long _sonar_echo_rise_micros;
+      volatile unsigned long _sonar_echo_fall_micros;
       uint8_t         _sonar_return_mode;
       unsigned long   _sonar_timeout;
-      _sonar_callback _sonar_change_callback;
+      uint8_t         _sonar_group;
+      unsigned long   _sonar_period_micros;
+      unsigned long   _sonar_last_trigger_micros;
+      unsigned int    _sonar_measures_counter;
+      unsigned int    _sonar_measures_per_second;
+      unsigned long   _sonar_measures_window_micros;
+      sonarSettings   _sonar_settings;
+      unsigned long   _sonar_samples[SONAR_MAX_MEDIAN_SAMPLES];
+      uint8_t         _sonar_samples_index;
+      uint8_t         _sonar_samples_counter;
+      uint8_t         _sonar_rejected_counter;
+      bool            _sonar_filter_started;
+      unsigned long   _sonar_last_sample;
+      long            _sonar_filtered;
+      bool            _sonar_delivered;
+      unsigned long   _sonar_last_value;
+      tweaklyevents::_callable _sonar_change_callback;
       _sonars *       _next_sonar = NULL;
     };
 
     _sonars   *_first_sonar =      NULL, *_last_sonar =  NULL;
+    tweaklystorage::_records<_sonars, TWEAKLY_STATIC_SONARS> _sonars_storage;
+
+    // Sonar served by each interrupt slot
+    _sonars   *_sonar_interrupt_slots[TWEAKLY_MAX_SONAR_INTERRUPTS];
+    uint8_t    _sonar_interrupt_counter = 0;
+
+    // Echo edge: timestamps the rising and the falling edge of the echo pulse
+    void IRAM_ATTR _sonar_echo_edge(_sonars *_this_sonar, unsigned long _edge_micros, bool _echo_status) {
+      if (_this_sonar->_sonar_progress_status == SONAR_WAIT_ECHO && _echo_status){
+        _this_sonar->_sonar_echo_rise_micros = _edge_micros;
+        _this_sonar->_sonar_progress_status = SONAR_ECHO;
+      } else if (_this_sonar->_sonar_progress_status == SONAR_ECHO && !_echo_status){
+        _this_sonar->_sonar_echo_fall_micros = _edge_micros;
+        _this_sonar->_sonar_progress_status = SONAR_ECHO_DONE;
+      }
+    }
+
+    // Interrupt service routine of a slot
+    template <uint8_t _slot>
+    void IRAM_ATTR _sonar_slot_isr() {
+      _sonars *_this_sonar = _sonar_interrupt_slots[_slot];
+      _sonar_echo_edge(_this_sonar, micros(), digitalRead(_this_sonar->_sonar_echo_pin));
+    }
+
+    const _sonar_isr _sonar_slot_isrs[TWEAKLY_MAX_SONAR_INTERRUPTS] = {
+      _sonar_slot_isr<0>, _sonar_slot_isr<1>, _sonar_slot_isr<2>, _sonar_slot_isr<3>
+    };
+
+#if defined(ARDUINO_PIN_CHANGE)
+    // Pin change interrupt of an echo pin without an external interrupt (AVR with TWEAKLY_PIN_CHANGE)
+    void _sonar_pin_change(void *_context) {
+      _sonars *_this_sonar = (_sonars *)_context;
+      _sonar_echo_edge(_this_sonar, micros(), digitalRead(_this_sonar->_sonar_echo_pin));
+    }
+#endif
+
+    // Give the echo pin of a sonar an interrupt slot if the board supports it, else a pin change interrupt if enabled
+    // The remaining sonars are polled by TweaklyRun: one loop of delay costs about 17cm of error per millisecond
+    void _sonar_attach_interrupt(_sonars *_this_sonar) {
+      _this_sonar->_sonar_interrupt = false;
+      int _interrupt = digitalPinToInterrupt(_this_sonar->_sonar_echo_pin);
+      if (_interrupt != NOT_AN_INTERRUPT && _sonar_interrupt_counter < TWEAKLY_MAX_SONAR_INTERRUPTS){
+        _sonar_interrupt_slots[_sonar_interrupt_counter] = _this_sonar;
+        attachInterrupt(_interrupt, _sonar_slot_isrs[_sonar_interrupt_counter], CHANGE);
+        _sonar_interrupt_counter++;
+        _this_sonar->_sonar_interrupt = true;
+      }
+#if defined(ARDUINO_PIN_CHANGE)
+      else if (arduino_boards::attachPinChange(_this_sonar->_sonar_echo_pin, _sonar_pin_change, _this_sonar)){
+        _this_sonar->_sonar_interrupt = true;
+      }
+#endif
+    }
+
+    // Convert an echo pulse to the return mode of the sonar
+    unsigned long _sonar_convert(uint8_t _return_mode, unsigned long micros) {
+      switch(_return_mode) {
+      case SONAR_MILLISECONDS : 
+        return micros / 1000;
+      case SONAR_CENTIMETERS : 
+        return micros / 29 / 2;
+      case SONAR_INCHES :
+        return micros / 74 / 2;
+      }
+      return micros;
+    }
+
+    // Median of the samples of a sonar (insertion sort on a copy, windows are small)
+    unsigned long _sonar_median(_sonars *_this_sonar) {
+      unsigned long _sorted[SONAR_MAX_MEDIAN_SAMPLES];
+      uint8_t _count = _this_sonar->_sonar_samples_counter;
+      for (uint8_t i = 0; i < _count; i++){
+        unsigned long _sample = _this_sonar->_sonar_samples[i];
+        uint8_t j = i;
+        while (j > 0 && _sorted[j - 1] > _sample){
+          _sorted[j] = _sorted[j - 1];
+          j--;
+        }
+        _sorted[j] = _sample;
+      }
+      return _sorted[_count / 2];
+    }
+
+    // Run an echo pulse through the filter pipeline and send it to the callback if it changed enough
+    void _sonar_deliver(_sonars *_this_sonar, unsigned long micros) {
+      sonarSettings *_settings = &_this_sonar->_sonar_settings;
+      // Outlier rejection: jumps from the last accepted echo are accepted only if they persist
+      if (_settings->maxJump != 0 && _this_sonar->_sonar_filter_started){
+        unsigned long _jump = micros > _this_sonar->_sonar_last_sample ? micros - _this_sonar->_sonar_last_sample : _this_sonar->_sonar_last_sample - micros;
+        if (_jump > _settings->maxJump && _this_sonar->_sonar_rejected_counter < _settings->maxRejected){
+          _this_sonar->_sonar_rejected_counter++;
+          return;
+        }
+      }
+      _this_sonar->_sonar_rejected_counter = 0;
+      _this_sonar->_sonar_last_sample = micros;
+      // Running median
+      if (_settings->medianSamples > 1){
+        _this_sonar->_sonar_samples[_this_sonar->_sonar_samples_index] = micros;
+        _this_sonar->_sonar_samples_index = (_this_sonar->_sonar_samples_index + 1) % _settings->medianSamples;
+        if (_this_sonar->_sonar_samples_counter < _settings->medianSamples){
+          _this_sonar->_sonar_samples_counter++;
+        }
+        micros = _sonar_median(_this_sonar);
+      }
+      // Exponential smoothing in fixed point: y += (x - y) / 2^smoothing
+      long _sample = (long)micros << SONAR_FILTER_FRACTION_BITS;
+      if (!_this_sonar->_sonar_filter_started || _settings->smoothing == 0){
+        _this_sonar->_sonar_filtered = _sample;
+        _this_sonar->_sonar_filter_started = true;
+      } else {
+        _this_sonar->_sonar_filtered += (_sample - _this_sonar->_sonar_filtered) >> _settings->smoothing;
+      }
+      // Change threshold, in the units of the return mode
+      unsigned long _value = _sonar_convert(_this_sonar->_sonar_return_mode, _this_sonar->_sonar_filtered >> SONAR_FILTER_FRACTION_BITS);
+      unsigned long _change = _value > _this_sonar->_sonar_last_value ? _value - _this_sonar->_sonar_last_value : _this_sonar->_sonar_last_value - _value;
+      if (!_this_sonar->_sonar_delivered || _change >= _settings->threshold){
+        _this_sonar->_sonar_delivered = true;
+        _this_sonar->_sonar_last_value = _value;
+        TWEAKLY_TRACE_EVENT(TRACE_SONAR_VALUE, _this_sonar->_sonar_echo_pin, _value);
+        tweaklyevents::_post_event(EVENT_FROM_SONAR, _this_sonar->_sonar_echo_pin, _this_sonar->_sonar_change_callback, EVENT_CALL_ULONG, _value, EVENT_REPLACE);
+      }
+    }
 
     // sonarAttach: attach a sonar
-    void sonarAttach(uint8_t _new_sonar_echo_pin, uint8_t _new_sonar_trigger_pin, _sonar_callback _new_sonar_change_callback, uint8_t _new_sonar_return_mode, unsigned long _new_sonar_timeout = 25000){
-      _sonars *_new_sonar = new _sonars;
+    void _sonar_attach(uint8_t _new_sonar_echo_pin, uint8_t _new_sonar_trigger_pin, const tweaklyevents::_callable &_new_sonar_change_callback, uint8_t _new_sonar_return_mode, unsigned long _new_sonar_timeout){
+      _sonars *_new_sonar = _sonars_storage.take();
       _new_sonar->_sonar_echo_pin = _new_sonar_echo_pin;
       _new_sonar->_sonar_trigger_pin = _new_sonar_trigger_pin;
       _new_sonar->_sonar_timeout = _new_sonar_timeout;
@@ -74,82 +258,226 @@ namespace sonar {
        _last_sonar->_next_sonar = _new_sonar;
       }
       _new_sonar->_sonar_change_callback = _new_sonar_change_callback;
-      _new_sonar->_sonar_progress_status = 0;
+      _new_sonar->_sonar_progress_status = SONAR_IDLE;
+      _new_sonar->_sonar_echo_previous_status = LOW;
       _new_sonar->_sonar_previous_micros = micros();
       _new_sonar->_sonar_return_mode = _new_sonar_return_mode;
+      _new_sonar->_sonar_group = _sonar_groups_counter++;
+      _new_sonar->_sonar_period_micros = 0;
+      _new_sonar->_sonar_last_trigger_micros = _new_sonar->_sonar_previous_micros;
+      _new_sonar->_sonar_measures_counter = 0;
+      _new_sonar->_sonar_measures_per_second = 0;
+      _new_sonar->_sonar_measures_window_micros = _new_sonar->_sonar_previous_micros;
+      _new_sonar->_sonar_samples_index = 0;
+      _new_sonar->_sonar_samples_counter = 0;
+      _new_sonar->_sonar_rejected_counter = 0;
+      _new_sonar->_sonar_filter_started = false;
+      _new_sonar->_sonar_delivered = false;
+      _sonar_attach_interrupt(_new_sonar);
       _last_sonar = _new_sonar;
       if (!_sonar_exists){
         _sonar_exists = true;
       }
     } 
 
+    // sonarGroup: sonar of the same group are triggered together (they must not hear each other), each sonar starts in its own group
+    void sonarGroup(uint8_t _sonar_echo_pin, uint8_t _new_sonar_group){
+      if (_sonar_exists){
+        _sonar_groups_counter = 0;
+        for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
+          if (_this_sonar->_sonar_echo_pin == _sonar_echo_pin){
+            _this_sonar->_sonar_group = _new_sonar_group;
+          }
+          if (_this_sonar->_sonar_group >= _sonar_groups_counter){
+            _sonar_groups_counter = _this_sonar->_sonar_group + 1;
+          }
+        }
+      }
+    }
+
+    template <typename _static_check = void>
+    void sonarAttach(uint8_t _new_sonar_echo_pin, uint8_t _new_sonar_trigger_pin, _sonar_callback _new_sonar_change_callback, uint8_t _new_sonar_return_mode, unsigned long _new_sonar_timeout = 25000){
+      _TWEAKLY_REQUIRES(TWEAKLY_STATIC_SONARS, "sonarAttach needs TWEAKLY_STATIC_SONARS in static mode");
+      _sonar_attach(_new_sonar_echo_pin, _new_sonar_trigger_pin, tweaklyevents::_make_callable(_new_sonar_change_callback), _new_sonar_return_mode, _new_sonar_timeout);
+    }
+
+    // sonarAttach: attach a sonar whose callback also receives _context, so one function can serve many sonars
+    template <typename _static_check = void>
+    void sonarAttach(uint8_t _new_sonar_echo_pin, uint8_t _new_sonar_trigger_pin, _sonar_context_callback _new_sonar_change_callback, void *_context, uint8_t _new_sonar_return_mode, unsigned long _new_sonar_timeout = 25000){
+      _TWEAKLY_REQUIRES(TWEAKLY_STATIC_SONARS, "sonarAttach needs TWEAKLY_STATIC_SONARS in static mode");
+      _sonar_attach(_new_sonar_echo_pin, _new_sonar_trigger_pin, tweaklyevents::_make_callable(_new_sonar_change_callback, _context), _new_sonar_return_mode, _new_sonar_timeout);
+    }
+
+    // sonarAdjust: set the filter pipeline of a sonar
+    void sonarAdjust(uint8_t _sonar_echo_pin, sonarSettings _new_settings){
+      if (_sonar_exists){
+        if (_new_settings.medianSamples > SONAR_MAX_MEDIAN_SAMPLES){
+          _new_settings.medianSamples = SONAR_MAX_MEDIAN_SAMPLES;
+        }
+        if (_new_settings.medianSamples == 0){
+          _new_settings.medianSamples = 1;
+        }
+        if (_new_settings.smoothing > SONAR_MAX_SMOOTHING){
+          _new_settings.smoothing = SONAR_MAX_SMOOTHING;
+        }
+        for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
+          if (_this_sonar->_sonar_echo_pin == _sonar_echo_pin){
+            _this_sonar->_sonar_settings = _new_settings;
+            _this_sonar->_sonar_samples_index = 0;
+            _this_sonar->_sonar_samples_counter = 0;
+            _this_sonar->_sonar_rejected_counter = 0;
+            _this_sonar->_sonar_filter_started = false;
+          }
+        }
+      }
+    }
+
+    // sonarRate: target measures per second of a sonar, 0 measures as fast as the scheduler allows
+    void sonarRate(uint8_t _sonar_echo_pin, unsigned int _measures_per_second){
+      if (_sonar_exists){
+        for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
+          if (_this_sonar->_sonar_echo_pin == _sonar_echo_pin){
+            _this_sonar->_sonar_period_micros = _measures_per_second == 0 ? 0 : 1000000UL / _measures_per_second;
+          }
+        }
+      }
+    }
+
+    // sonarQuietTime: minimum silence between the end of a group and the trigger of the next one
+    void sonarQuietTime(unsigned long _new_quiet_micros){
+      _sonar_quiet_micros = _new_quiet_micros;
+    }
+
+    // sonarMeasuresPerSecond: measures delivered by a sonar in the last second
+    unsigned int sonarMeasuresPerSecond(uint8_t _sonar_echo_pin){
+      unsigned int _measures_per_second = 0;
+      if (_sonar_exists){
+        for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
+          if (_this_sonar->_sonar_echo_pin == _sonar_echo_pin){
+            _measures_per_second = _this_sonar->_sonar_measures_per_second;
+          }
+        }
+      }
+      return _measures_per_second;
+    }
+
+    // Trigger the sonar of a group whose rate period is elapsed, returns true if at least one was started
+    bool _sonar_start_group(uint8_t _group, unsigned long _current_micros) {
+      bool _started = false;
+      for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
+        if (_this_sonar->_sonar_group == _group && _this_sonar->_sonar_progress_status == SONAR_IDLE &&
+            (unsigned long)(_current_micros - _this_sonar->_sonar_last_trigger_micros) >= _this_sonar->_sonar_period_micros){
+          _this_sonar->_sonar_last_trigger_micros = _current_micros;
+          _this_sonar->_sonar_previous_micros = _current_micros;
+          _this_sonar->_sonar_progress_status = SONAR_START;
+          _started = true;
+        }
+      }
+      return _started;
+    }
+
     // Setup for all sonar
     void Setup() {
       if (_sonar_exists){
         for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
         unsigned long _current_micros = micros();
         _this_sonar->_sonar_previous_micros = _current_micros;
+        _this_sonar->_sonar_measures_window_micros = _current_micros;
         }
+        _sonar_quiet_previous_micros = micros();
       }
     }
     
-    // Loop for all sonar
+    // Loop for all sonar: never waits for the echo, the pulse is timestamped by interrupts (or polled edges)
     void Loop() {
       if (_sonar_exists){
         unsigned long _current_micros = micros();
+        bool _group_busy = false;
         for (_sonars *_this_sonar = _first_sonar; _this_sonar != NULL; _this_sonar = _this_sonar->_next_sonar){
           _current_micros = micros();
           _this_sonar->_sonar_current_micros = _current_micros;
-          if(_this_sonar->_sonar_progress_status == 0) {
+          if ((unsigned long)(_current_micros - _this_sonar->_sonar_measures_window_micros) >= 1000000UL){
+            _this_sonar->_sonar_measures_window_micros += 1000000UL;
+            _this_sonar->_sonar_measures_per_second = _this_sonar->_sonar_measures_counter;
+            _this_sonar->_sonar_measures_counter = 0;
+          }
+          switch(_this_sonar->_sonar_progress_status) {
+          case SONAR_IDLE :
+          break;
+          case SONAR_START :
             digitalWrite(_this_sonar->_sonar_trigger_pin, LOW);
             _this_sonar->_sonar_delay_micros = 10;
             if ((unsigned long)(_this_sonar->_sonar_current_micros - _this_sonar->_sonar_previous_micros) >= _this_sonar->_sonar_delay_micros){
                digitalWrite(_this_sonar->_sonar_trigger_pin, HIGH);
                _this_sonar->_sonar_delay_micros = 20;
-               _current_micros = micros();
-               _this_sonar->_sonar_previous_micros = _current_micros;
-               _this_sonar->_sonar_progress_status = 1;
+               _this_sonar->_sonar_previous_micros = micros();
+               _this_sonar->_sonar_progress_status = SONAR_TRIGGER;
             }
-          }
-          if(_this_sonar->_sonar_progress_status == 1) {
+          break;
+          case SONAR_TRIGGER :
              if ((unsigned long)(_this_sonar->_sonar_current_micros - _this_sonar->_sonar_previous_micros) >= _this_sonar->_sonar_delay_micros){
                digitalWrite(_this_sonar->_sonar_trigger_pin, LOW);
-               _current_micros = micros();
-              _this_sonar->_sonar_previous_micros = _current_micros;
-               _this_sonar->_sonar_progress_status = 2;
+               _this_sonar->_sonar_previous_micros = micros();
+               _this_sonar->_sonar_echo_previous_status = LOW;
+               _this_sonar->_sonar_progress_status = SONAR_WAIT_ECHO;
+             }
+          break;
+          case SONAR_ECHO_DONE :
+             _this_sonar->_sonar_previous_micros = _current_micros;
+             _this_sonar->_sonar_progress_status = SONAR_IDLE;
+             _this_sonar->_sonar_measures_counter++;
+             _sonar_deliver(_this_sonar, _this_sonar->_sonar_echo_fall_micros - _this_sonar->_sonar_echo_rise_micros);
+          break;
+          default :
+             if (!_this_sonar->_sonar_interrupt){
+               bool _echo_status = digitalRead(_this_sonar->_sonar_echo_pin);
+               if (_echo_status != _this_sonar->_sonar_echo_previous_status){
+                 _this_sonar->_sonar_echo_previous_status = _echo_status;
+                 _sonar_echo_edge(_this_sonar, _current_micros, _echo_status);
+               }
+             }
+             if ((unsigned long)(_this_sonar->_sonar_current_micros - _this_sonar->_sonar_previous_micros) >= _this_sonar->_sonar_timeout){
+               // No echo within the timeout: like pulseIn returning 0, nothing is sent
+               noInterrupts();
+               if (_this_sonar->_sonar_progress_status != SONAR_ECHO_DONE){
+                 _this_sonar->_sonar_previous_micros = _current_micros;
+                 _this_sonar->_sonar_progress_status = SONAR_IDLE;
+               }
+               interrupts();
              }
+          break;
           }
-          if(_this_sonar->_sonar_progress_status == 2) {
-             unsigned long micros;
-             micros = pulseIn(_this_sonar->_sonar_echo_pin, HIGH, _this_sonar->_sonar_timeout);
-             if(micros != 0) {
-             switch(_this_sonar->_sonar_return_mode) {
-             case SONAR_MICROSECONDS : 
-                _this_sonar->_sonar_change_callback(micros);
-             break;
-             case SONAR_MILLISECONDS : 
-               unsigned long millis;
-               millis = micros / 1000;
-                _this_sonar->_sonar_change_callback(millis);
-             break;
-             case SONAR_CENTIMETERS : 
-               unsigned long distance_cm;
-               distance_cm = micros / 29 / 2;
-                _this_sonar->_sonar_change_callback(distance_cm);
-             break;
-             case SONAR_INCHES :
-               unsigned long distance_inches;
-               distance_inches = micros / 74 / 2;
-                _this_sonar->_sonar_change_callback(distance_inches);
-             break;
-           }
+          if (_this_sonar->_sonar_progress_status != SONAR_IDLE){
+            _group_busy = true;
+          }
+       } 
+       if (!_group_busy){
+         if (_sonar_group_running){
+           _sonar_group_running = false;
+           _sonar_quiet_previous_micros = _current_micros;
+         }
+         if ((unsigned long)(_current_micros - _sonar_quiet_previous_micros) >= _sonar_quiet_micros){
+           for (uint8_t _tries = 0; _tries < _sonar_groups_counter; _tries++){
+             _sonar_active_group = (_sonar_active_group + 1) % _sonar_groups_counter;
+             if (_sonar_start_group(_sonar_active_group, _current_micros)){
+               _sonar_group_running = true;
+               break;
              }
-         _this_sonar->_sonar_progress_status = 0;
+           }
          }
-       } 
+       }
      }
    }
 
+    // Idle while there are no sonars
+    bool _sonars_idle() {
+      return !_sonar_exists;
+    }
+
+    #if _TWEAKLY_USES(TWEAKLY_STATIC_SONARS)
+    tweaklyrun::Module _sonars_module("sonar", Loop, MODULE_ORDER_SONAR, Setup, _sonars_idle);
+    #endif
+
 }
 
 #endif